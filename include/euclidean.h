@@ -18,15 +18,117 @@
 #ifndef EUCLIDEAN_H
 #define EUCLIDEAN_H
 
-#define EUCLIDEAN_URI "https://github.com/bruno-unna/euclidean-rhythms"
-#define EUCLIDEAN_UI_URI "https://github.com/bruno-unna/euclidean-rhythms#ui"
+#include <stdbool.h>
+#include <stdint.h>
 
+// How many generators a plugin has. Each variant is built from the same source with its own value.
+#ifndef N_GENERATORS
 #define N_GENERATORS 8
+#endif
+#if N_GENERATORS < 1 || N_GENERATORS > 64
+#error "N_GENERATORS must be between 1 and 64"
+#endif
 #define N_PARAMETERS 8
 
+#define EUCLIDEAN_STRINGIFY(x) #x
+#define EUCLIDEAN_TO_STRING(x) EUCLIDEAN_STRINGIFY(x)
+
+// The plugin with eight generators is the original one, and keeps its URI
+#define EUCLIDEAN_BASE_URI "https://github.com/bruno-unna/euclidean-rhythms"
+#if N_GENERATORS == 8
+#define EUCLIDEAN_URI EUCLIDEAN_BASE_URI
+#else
+#define EUCLIDEAN_URI EUCLIDEAN_BASE_URI "#generators-" EUCLIDEAN_TO_STRING(N_GENERATORS)
+#endif
+#define EUCLIDEAN_UI_URI EUCLIDEAN_BASE_URI "#ui"
+
+// Longest pattern (in beats) that fits in a single pattern word
+#define WORD_BEATS 64
+
+// Longest pattern (in beats) that a generator can play
+#define MAX_BEATS 512
+#define PATTERN_WORDS (MAX_BEATS / WORD_BEATS)
+
 #define CONTROL_PORT 0
 #define MIDI_OUT_PORT 1
 
+// The notify port comes after the ports of all the generators, so that theirs keep the indexes they always had
+#define NOTIFY_PORT (2 + N_GENERATORS * N_PARAMETERS)
+
+// ...and the gate length of each generator, a percentage of its step (0 for the shortest note), after it
+#define GATE_PORT(generator) (NOTIFY_PORT + 1 + (generator))
+#define MAX_GATE 1600
+
+// ...then whether the plugin keeps time by itself, rather than following the transport of the host, and its tempo then
+#define CLOCK_PORT GATE_PORT(N_GENERATORS)
+#define TEMPO_PORT (CLOCK_PORT + 1)
+#define MIN_TEMPO 20
+#define MAX_TEMPO 300
+#define DEFAULT_TEMPO 120
+#define DEFAULT_BEATS_PER_BAR 4   // for the internal clock, if the host never said
+
+// ...and last the groove of each generator: how much it swings, and how much its timing and its velocity are
+// humanized. The steps of a generator always stay in order, however much it swings and is humanized.
+#define SWING_PORT(generator) (TEMPO_PORT + 1 + 3 * (generator))
+#define TIMING_PORT(generator) (SWING_PORT(generator) + 1)
+#define DYNAMICS_PORT(generator) (SWING_PORT(generator) + 2)
+#define MAX_SWING 50      // percentage of a step by which every other step is delayed
+#define MAX_TIMING 25     // largest shift of a step, either way, as a percentage of a step
+#define MAX_DYNAMICS 64   // largest change of velocity, either way
+
+// The property under which the state extension saves the generators
+#define EUCLIDEAN__snapshot EUCLIDEAN_BASE_URI "#snapshot"
+
+// What the plugin publishes on the notify port, about once a second: an object with what happened in run() since
+// the previous one
+#define EUCLIDEAN__Telemetry EUCLIDEAN_BASE_URI "#Telemetry"
+#define EUCLIDEAN__blocks EUCLIDEAN_BASE_URI "#blocks"                 // run() calls
+#define EUCLIDEAN__cycles EUCLIDEAN_BASE_URI "#cycles"                 // CPU cycles spent in them (0 if unknown)
+#define EUCLIDEAN__worstCycles EUCLIDEAN_BASE_URI "#worstCycles"       // ...by the most expensive one
+#define EUCLIDEAN__events EUCLIDEAN_BASE_URI "#events"                 // MIDI events written to the output
+#define EUCLIDEAN__droppedEvents EUCLIDEAN_BASE_URI "#droppedEvents"   // ...and those that didn't fit in it
+#define EUCLIDEAN__recalculations EUCLIDEAN_BASE_URI "#recalculations" // onsets of a generator listed again
+#define EUCLIDEAN__lateOnsets EUCLIDEAN_BASE_URI "#lateOnsets"         // played after their time
+#define EUCLIDEAN__missedOnsets EUCLIDEAN_BASE_URI "#missedOnsets"     // not played, too many notes sounding
+
+// Besides through its ports, the parameters of a generator can be changed with patch messages on the control port,
+// which take effect at the very frame they come at: a patch:Set of one of the properties below, or a patch:Put with
+// as many of them as needed in its patch:body. Either says which generator (counting from 0) it is for as its
+// EUCLIDEAN__generator. Values may be ints, longs, floats, doubles or bools, and mean what they mean on the ports.
+#define EUCLIDEAN__generator EUCLIDEAN_BASE_URI "#generator"
+#define EUCLIDEAN__enabled EUCLIDEAN_BASE_URI "#enabled"
+#define EUCLIDEAN__beats EUCLIDEAN_BASE_URI "#beats"
+#define EUCLIDEAN__onsets EUCLIDEAN_BASE_URI "#onsets"
+#define EUCLIDEAN__rotation EUCLIDEAN_BASE_URI "#rotation"
+#define EUCLIDEAN__bars EUCLIDEAN_BASE_URI "#bars"
+#define EUCLIDEAN__channel EUCLIDEAN_BASE_URI "#channel"
+#define EUCLIDEAN__note EUCLIDEAN_BASE_URI "#note"
+#define EUCLIDEAN__velocity EUCLIDEAN_BASE_URI "#velocity"
+#define EUCLIDEAN__gate EUCLIDEAN_BASE_URI "#gate"
+#define EUCLIDEAN__swing EUCLIDEAN_BASE_URI "#swing"
+#define EUCLIDEAN__timing EUCLIDEAN_BASE_URI "#timing"
+#define EUCLIDEAN__dynamics EUCLIDEAN_BASE_URI "#dynamics"
+#define EUCLIDEAN__combination EUCLIDEAN_BASE_URI "#combination"
+#define EUCLIDEAN__first EUCLIDEAN_BASE_URI "#first"
+#define EUCLIDEAN__second EUCLIDEAN_BASE_URI "#second"
+
+// Besides its parameters, a generator has lanes that say, step by step, how the onsets that fall on each step of its
+// grid are played. Patch messages set a lane with a string of a character per step, from the first one: a digit from
+// 0 to 3, or an x meaning 1, anything else being 0. Steps past the end of the string are 0.
+#define EUCLIDEAN__accent EUCLIDEAN_BASE_URI "#accent"            // 1: louder, by ACCENT_VELOCITY
+#define EUCLIDEAN__probability EUCLIDEAN_BASE_URI "#probability"  // 0: always played, 1: 3 times in 4, 2: 1 in 2,
+                                                                  // 3: 1 in 4
+#define EUCLIDEAN__level EUCLIDEAN_BASE_URI "#level"              // 0: the velocity, 1: 3/4 of it, 2: half, 3: 1/4
+
+#define ACCENT_VELOCITY 32
+
+enum {
+    ACCENT_LANE = 0,
+    PROBABILITY_LANE = 1,
+    LEVEL_LANE = 2,
+    N_LANES = 3,
+};
+
 enum {
     ENABLED_IDX = 0,
     BEATS_IDX = 1,
@@ -36,8 +138,56 @@ enum {
     CHANNEL_IDX = 5,
     NOTE_IDX = 6,
     VELOCITY_IDX = 7,
+    // not among the N_PARAMETERS ports of a generator, their ports come after the notify port
+    GATE_IDX = 8,
+    SWING_IDX = 9,
+    TIMING_IDX = 10,
+    DYNAMICS_IDX = 11,
+    // ...and these have no ports at all, only patch messages set them
+    COMBINATION_IDX = 12,
+    FIRST_IDX = 13,
+    SECOND_IDX = 14,
 };
 
-unsigned long e(unsigned short onsets, unsigned short beats, short rotation);
+// Every parameter of a generator, those without ports of their own included
+#define N_PROPERTIES (N_PARAMETERS + 7)
+
+// Instead of a Euclidean pattern of its own, a generator may play a combination of the Euclidean patterns of two
+// generators (its first and its second, which may be itself), over its own beats and with its own rotation. Its
+// onsets don't matter then.
+enum {
+    COMBINE_NONE = 0,
+    COMBINE_AND = 1,
+    COMBINE_OR = 2,
+    COMBINE_XOR = 3,
+    COMBINE_AND_NOT = 4,   // the onsets of the first generator that the second one doesn't have
+    N_COMBINATIONS = 5,
+};
+
+// A pattern of up to MAX_BEATS beats. Beat 0 is the most significant bit of w[0], beat 64 the most significant
+// bit of w[1], and so on; bits past the length of the pattern are always zero.
+typedef struct {
+    uint64_t w[PATTERN_WORDS];
+} pattern;
+
+uint64_t rotate(uint64_t pattern, unsigned short beats, short rotation);
+
+uint64_t e(unsigned short onsets, unsigned short beats, short rotation);
+
+void pattern_euclidean(pattern *p, unsigned short onsets, unsigned short beats, short rotation);
+
+void pattern_rotate(pattern *p, unsigned short beats, short rotation);
+
+unsigned short pattern_count(const pattern *p);
+
+unsigned short pattern_next(const pattern *p, unsigned short beats, unsigned short from);
+
+static inline bool pattern_test(const pattern *p, unsigned short beat) {
+    return (p->w[beat / WORD_BEATS] >> (WORD_BEATS - 1 - beat % WORD_BEATS)) & 1;
+}
+
+static inline void pattern_set(pattern *p, unsigned short beat) {
+    p->w[beat / WORD_BEATS] |= 1ULL << (WORD_BEATS - 1 - beat % WORD_BEATS);
+}
 
 #endif //EUCLIDEAN_H
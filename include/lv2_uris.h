@@ -23,16 +23,24 @@
 #include <lv2/lv2plug.in/ns/ext/midi/midi.h>
 #include "lv2/patch/patch.h"
 #include "lv2/urid/urid.h"
+#include "euclidean.h"
 
 typedef struct {
+    LV2_URID atom_Bool;
+    LV2_URID atom_Chunk;
+    LV2_URID atom_Double;
     LV2_URID atom_Float;
+    LV2_URID atom_Int;
     LV2_URID atom_Long;
     LV2_URID atom_Object;
     LV2_URID atom_Path;
     LV2_URID atom_Sequence;
+    LV2_URID atom_String;
     LV2_URID atom_URID;
     LV2_URID midi_Event;
+    LV2_URID patch_Put;
     LV2_URID patch_Set;
+    LV2_URID patch_body;
     LV2_URID patch_property;
     LV2_URID patch_value;
     LV2_URID time_Position;
@@ -41,26 +49,78 @@ typedef struct {
     LV2_URID time_beats_per_minute;
     LV2_URID time_beats_per_bar;
     LV2_URID time_bar;
+    LV2_URID time_bar_beat;
     LV2_URID time_frame;
     LV2_URID time_speed;
+    LV2_URID state_snapshot;
+    LV2_URID telemetry_Telemetry;
+    LV2_URID telemetry_blocks;
+    LV2_URID telemetry_cycles;
+    LV2_URID telemetry_worst_cycles;
+    LV2_URID telemetry_events;
+    LV2_URID telemetry_dropped_events;
+    LV2_URID telemetry_recalculations;
+    LV2_URID telemetry_late_onsets;
+    LV2_URID telemetry_missed_onsets;
+    LV2_URID parameter_generator;
+    LV2_URID parameters[N_PROPERTIES];  // by the index of the parameter
+    LV2_URID lanes[N_LANES];            // ...and of the lane
 } Euclidean_URIs;
 
 static inline void map_uris(LV2_URID_Map *map, Euclidean_URIs *uris) {
+    uris->atom_Bool = map->map(map->handle, LV2_ATOM__Bool);
+    uris->atom_Chunk = map->map(map->handle, LV2_ATOM__Chunk);
+    uris->atom_Double = map->map(map->handle, LV2_ATOM__Double);
     uris->atom_Float = map->map(map->handle, LV2_ATOM__Float);
+    uris->atom_Int = map->map(map->handle, LV2_ATOM__Int);
+    uris->atom_Long = map->map(map->handle, LV2_ATOM__Long);
     uris->atom_Object = map->map(map->handle, LV2_ATOM__Object);
     uris->atom_Path = map->map(map->handle, LV2_ATOM__Path);
     uris->atom_Sequence = map->map(map->handle, LV2_ATOM__Sequence);
+    uris->atom_String = map->map(map->handle, LV2_ATOM__String);
     uris->atom_URID = map->map(map->handle, LV2_ATOM__URID);
     uris->midi_Event = map->map(map->handle, LV2_MIDI__MidiEvent);
+    uris->patch_Put = map->map(map->handle, LV2_PATCH__Put);
     uris->patch_Set = map->map(map->handle, LV2_PATCH__Set);
+    uris->patch_body = map->map(map->handle, LV2_PATCH__body);
     uris->patch_property = map->map(map->handle, LV2_PATCH__property);
     uris->patch_value = map->map(map->handle, LV2_PATCH__value);
     uris->time_Position = map->map(map->handle, LV2_TIME__Position);
     uris->time_beats_per_minute = map->map(map->handle, LV2_TIME__beatsPerMinute);
     uris->time_beats_per_bar = map->map(map->handle, LV2_TIME__beatsPerBar);
     uris->time_bar = map->map(map->handle, LV2_TIME__bar);
+    uris->time_bar_beat = map->map(map->handle, LV2_TIME__barBeat);
     uris->time_frame = map->map(map->handle, LV2_TIME__frame);
     uris->time_speed = map->map(map->handle, LV2_TIME__speed);
+    uris->state_snapshot = map->map(map->handle, EUCLIDEAN__snapshot);
+    uris->telemetry_Telemetry = map->map(map->handle, EUCLIDEAN__Telemetry);
+    uris->telemetry_blocks = map->map(map->handle, EUCLIDEAN__blocks);
+    uris->telemetry_cycles = map->map(map->handle, EUCLIDEAN__cycles);
+    uris->telemetry_worst_cycles = map->map(map->handle, EUCLIDEAN__worstCycles);
+    uris->telemetry_events = map->map(map->handle, EUCLIDEAN__events);
+    uris->telemetry_dropped_events = map->map(map->handle, EUCLIDEAN__droppedEvents);
+    uris->telemetry_recalculations = map->map(map->handle, EUCLIDEAN__recalculations);
+    uris->telemetry_late_onsets = map->map(map->handle, EUCLIDEAN__lateOnsets);
+    uris->telemetry_missed_onsets = map->map(map->handle, EUCLIDEAN__missedOnsets);
+    uris->parameter_generator = map->map(map->handle, EUCLIDEAN__generator);
+    uris->parameters[ENABLED_IDX] = map->map(map->handle, EUCLIDEAN__enabled);
+    uris->parameters[BEATS_IDX] = map->map(map->handle, EUCLIDEAN__beats);
+    uris->parameters[ONSETS_IDX] = map->map(map->handle, EUCLIDEAN__onsets);
+    uris->parameters[ROTATION_IDX] = map->map(map->handle, EUCLIDEAN__rotation);
+    uris->parameters[BARS_IDX] = map->map(map->handle, EUCLIDEAN__bars);
+    uris->parameters[CHANNEL_IDX] = map->map(map->handle, EUCLIDEAN__channel);
+    uris->parameters[NOTE_IDX] = map->map(map->handle, EUCLIDEAN__note);
+    uris->parameters[VELOCITY_IDX] = map->map(map->handle, EUCLIDEAN__velocity);
+    uris->parameters[GATE_IDX] = map->map(map->handle, EUCLIDEAN__gate);
+    uris->parameters[SWING_IDX] = map->map(map->handle, EUCLIDEAN__swing);
+    uris->parameters[TIMING_IDX] = map->map(map->handle, EUCLIDEAN__timing);
+    uris->parameters[DYNAMICS_IDX] = map->map(map->handle, EUCLIDEAN__dynamics);
+    uris->parameters[COMBINATION_IDX] = map->map(map->handle, EUCLIDEAN__combination);
+    uris->parameters[FIRST_IDX] = map->map(map->handle, EUCLIDEAN__first);
+    uris->parameters[SECOND_IDX] = map->map(map->handle, EUCLIDEAN__second);
+    uris->lanes[ACCENT_LANE] = map->map(map->handle, EUCLIDEAN__accent);
+    uris->lanes[PROBABILITY_LANE] = map->map(map->handle, EUCLIDEAN__probability);
+    uris->lanes[LEVEL_LANE] = map->map(map->handle, EUCLIDEAN__level);
 }
 
 #endif //LV2_URIS_H
@@ -0,0 +1,69 @@
+/*
+ * Copyright 2023, 2024 by Bruno Unna.
+ *
+ * This file is part of Euclidean Rhythms.
+ *
+ * Euclidean Rhythms is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * Euclidean Rhythms is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with Euclidean Rhythms.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef PATTERN_CACHE_H
+#define PATTERN_CACHE_H
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "euclidean.h"
+
+// Marks the end of the onsets of a pattern
+#define NO_ONSET USHRT_MAX
+
+// A pattern and its onsets, computed once and shared, read only, by every instance in the process that plays it
+typedef struct Pattern_entry {
+    struct Pattern_entry *retired_next; // once the entry has been pushed out of the cache
+    uint32_t references;                // layouts borrowing the entry; those nobody borrows may be pushed out
+    unsigned short onsets;
+    unsigned short beats;
+    short rotation;
+    bool derived;                       // not a Euclidean pattern, told apart from the others by the pattern itself
+    pattern euclidean;
+    unsigned short steps[];             // the beats with an onset, in order, followed by NO_ONSET
+} Pattern_entry;
+
+// Room for an entry with as many onsets as a pattern can have, rounded up so that entries can be laid out one after
+// another
+#define PATTERN_ENTRY_SIZE ((sizeof(Pattern_entry) + (MAX_BEATS + 1) * sizeof(unsigned short) + 7) / 8 * 8)
+
+// Borrow the entry for a pattern, computing it if no instance did before (unless `known`, the pattern itself, is
+// given). Allocates memory, so it is not to be called from the audio thread. Returns NULL when there is no memory
+// left.
+const Pattern_entry *pattern_cache_acquire(unsigned short onsets, unsigned short beats, short rotation,
+                                           const pattern *known);
+
+// Borrow the entry for a pattern of `beats` beats that isn't Euclidean (such as one combining others), computing its
+// onsets if no instance did before. Its `onsets` are how many it has, and its rotation 0. Allocates memory, and
+// returns NULL when there is none left, as pattern_cache_acquire() does.
+const Pattern_entry *pattern_cache_acquire_pattern(const pattern *p, unsigned short beats);
+
+// Fill in an entry that an instance keeps for itself, out of the cache, with room for PATTERN_ENTRY_SIZE bytes.
+// Allocates nothing, so the audio thread may do it.
+void pattern_entry_fill(Pattern_entry *entry, const pattern *p, unsigned short onsets, unsigned short beats,
+                        short rotation, bool derived);
+
+// Give back a borrowed entry (NULL is ignored). Safe for the audio thread: it frees nothing, pattern_cache_collect()
+// does.
+void pattern_cache_release(const Pattern_entry *entry);
+
+// Free the entries pushed out of the cache that nobody borrows any longer. Not for the audio thread.
+void pattern_cache_collect(void);
+
+#endif //PATTERN_CACHE_H
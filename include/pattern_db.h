@@ -0,0 +1,85 @@
+/*
+ * Copyright 2023, 2024 by Bruno Unna.
+ *
+ * This file is part of Euclidean Rhythms.
+ *
+ * Euclidean Rhythms is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * Euclidean Rhythms is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with Euclidean Rhythms.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef PATTERN_DB_H
+#define PATTERN_DB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "euclidean.h"
+
+// A file, generated at build time and installed in the bundle, with every Euclidean pattern of up to `max_beats`
+// beats, unrotated, and what there is to know about it. It is mapped into memory rather than read, so every instance
+// in every process shares the same pages. Its layout is: the header, a record per pattern, and the words of the
+// patterns. Numbers are in the byte order of the machine that built it.
+
+#define PATTERN_DB_FILE "patterns.db"
+#define PATTERN_DB_MAGIC "EUCLIDDB"
+#define PATTERN_DB_VERSION 1
+#define PATTERN_DB_BYTE_ORDER 0x01020304u
+
+// Records for patterns of 1 to `max_beats` beats, and 0 to `beats` onsets each
+#define PATTERN_DB_RECORDS(max_beats) ((uint32_t) (max_beats) * ((max_beats) + 3) / 2)
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;    // PATTERN_DB_BYTE_ORDER, as the machine that built the file writes it
+    uint32_t max_beats;
+    uint32_t n_records;
+    uint64_t words_offset;  // from the start of the file
+    uint64_t size;          // of the whole file
+} Pattern_db_header;
+
+typedef struct {
+    uint16_t onsets;
+    uint16_t beats;
+    uint16_t canonical_rotation; // that turns the pattern into the representative of its necklace
+    uint16_t period;             // smallest rotation that leaves the pattern as it is
+    uint32_t necklace;           // shared by the pattern and all its rotations, and by nothing else
+    uint32_t word;               // first word of the pattern, counting from the start of the words
+    float evenness;              // mean distance between two onsets, as chords of a circle of diameter 1
+    float deviation;             // standard deviation of the intervals between onsets, in beats
+} Pattern_db_record;
+
+// A database as mapped by pattern_db_open(). Zeroed, it is a database that has nothing.
+typedef struct {
+    void *map;
+    size_t size;
+    const Pattern_db_header *header;
+    const Pattern_db_record *records;
+    const uint64_t *words;
+    uint64_t n_words;
+} Pattern_db;
+
+// Write the database for patterns of up to `max_beats` beats (at most MAX_BEATS) to `path`
+bool pattern_db_build(const char *path, unsigned short max_beats);
+
+// Map, read only, the database of a bundle. Leaves `db` empty if there is none, or it isn't usable.
+bool pattern_db_open(Pattern_db *db, const char *bundle_path);
+
+void pattern_db_close(Pattern_db *db);
+
+// The record of the unrotated pattern, or NULL if the database doesn't have it
+const Pattern_db_record *pattern_db_record(const Pattern_db *db, unsigned short onsets, unsigned short beats);
+
+// Copy a pattern out of the database, as pattern_euclidean() would compute it. False if the database doesn't have it.
+bool pattern_db_find(const Pattern_db *db, unsigned short onsets, unsigned short beats, short rotation, pattern *p);
+
+#endif //PATTERN_DB_H
@@ -0,0 +1,79 @@
+/*
+ * Copyright 2023, 2024 by Bruno Unna.
+ *
+ * This file is part of Euclidean Rhythms.
+ *
+ * Euclidean Rhythms is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * Euclidean Rhythms is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with Euclidean Rhythms.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef RT_LOG_H
+#define RT_LOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// A log that the audio thread can write to without formatting, locking or making system calls: messages are queued
+// as fixed-size records (a code and its arguments) in a ring with a single producer and a single consumer, and
+// formatted later by whoever consumes them.
+
+// Must be a power of two
+#define RT_LOG_CAPACITY 1024
+
+typedef struct {
+    uint32_t code;
+    uint32_t generator;
+    int64_t value;
+} RT_log_record;
+
+typedef struct {
+    RT_log_record records[RT_LOG_CAPACITY];
+    uint32_t head;    // only written by the producer
+    uint32_t tail;    // only written by the consumer
+    uint32_t dropped; // records that found the ring full
+} RT_log;
+
+// Producer side. When the ring is full the record is dropped, and counted.
+static inline void rt_log_push(RT_log *log, uint32_t code, uint32_t generator, int64_t value) {
+    const uint32_t head = log->head;
+    if (head - __atomic_load_n(&log->tail, __ATOMIC_ACQUIRE) == RT_LOG_CAPACITY) {
+        __atomic_fetch_add(&log->dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    RT_log_record *record = &log->records[head & (RT_LOG_CAPACITY - 1)];
+    record->code = code;
+    record->generator = generator;
+    record->value = value;
+    __atomic_store_n(&log->head, head + 1, __ATOMIC_RELEASE);
+}
+
+// Producer side: whether there is anything for the consumer
+static inline bool rt_log_pending(RT_log *log) {
+    return log->head != __atomic_load_n(&log->tail, __ATOMIC_ACQUIRE);
+}
+
+// Consumer side
+static inline bool rt_log_pop(RT_log *log, RT_log_record *record) {
+    const uint32_t tail = log->tail;
+    if (tail == __atomic_load_n(&log->head, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    *record = log->records[tail & (RT_LOG_CAPACITY - 1)];
+    __atomic_store_n(&log->tail, tail + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+// Consumer side: how many records were dropped since the last time it asked
+static inline uint32_t rt_log_take_dropped(RT_log *log) {
+    return __atomic_exchange_n(&log->dropped, 0, __ATOMIC_RELAXED);
+}
+
+#endif //RT_LOG_H
@@ -15,77 +15,176 @@
  * If not, see <https://www.gnu.org/licenses/>.
  */
 
-#include <stdio.h>
+#include <string.h>
+
+#include "euclidean.h"
 
 typedef struct {
     unsigned short n; // how many repetitions?
-    unsigned long v;  // of what sequence?
+    pattern v;        // of what sequence?
     unsigned short s; // how long is the sequence?
 } repeats;
 
+// Every unrotated single-word pattern, indexed by [beats][onsets]. Entries where onsets > beats hold all beats set.
+static uint64_t patterns[WORD_BEATS + 1][WORD_BEATS + 1];
+
+// OR into `dst` the beats of `src`, moved `k` places later (towards the end of the pattern)
+static void or_later(pattern *dst, const pattern *src, unsigned short k) {
+    const unsigned short q = k / WORD_BEATS;
+    const unsigned short b = k % WORD_BEATS;
+    for (int j = PATTERN_WORDS - 1; j >= q; --j) {
+        uint64_t w = src->w[j - q] >> b;
+        if (b != 0 && j - q > 0) w |= src->w[j - q - 1] << (WORD_BEATS - b);
+        dst->w[j] |= w;
+    }
+}
+
+// OR into `dst` the beats of `src`, moved `k` places earlier (towards the beginning of the pattern)
+static void or_earlier(pattern *dst, const pattern *src, unsigned short k) {
+    const unsigned short q = k / WORD_BEATS;
+    const unsigned short b = k % WORD_BEATS;
+    for (int j = 0; j + q < PATTERN_WORDS; ++j) {
+        uint64_t w = src->w[j + q] << b;
+        if (b != 0 && j + q + 1 < PATTERN_WORDS) w |= src->w[j + q + 1] >> (WORD_BEATS - b);
+        dst->w[j] |= w;
+    }
+}
+
+// Clear every bit past the end of a pattern of `beats` beats
+static void truncate_pattern(pattern *p, unsigned short beats) {
+    for (unsigned short j = 0; j < PATTERN_WORDS; ++j) {
+        if (j * WORD_BEATS >= beats) {
+            p->w[j] = 0;
+        } else if ((j + 1) * WORD_BEATS > beats) {
+            p->w[j] &= ~0ULL << (WORD_BEATS - beats % WORD_BEATS);
+        }
+    }
+}
+
 void er(repeats *g, repeats *r) {
     while (r->n > 1) {
         if (g->n <= r->n) {
             // distribute some elements of `r` amongst the elements of `g`
             r->n -= g->n;
+            or_later(&g->v, &r->v, g->s);
             g->s += r->s;
-            g->v <<= r->s;
-            g->v |= r->v;
         } else {
             // forget `r` and split old `g` unto new `g` and new `r`
             repeats rt = *r;    // this is black magic: I don't need to memcpy the struct!
             r->v = g->v;
             r->n = g->n - r->n;
             r->s = g->s;
-            g->v <<= rt.s;
-            g->v |= rt.v;
+            or_later(&g->v, &rt.v, g->s);
             g->s += rt.s;
             g->n = rt.n;
         }
     }
 }
 
-unsigned long e(unsigned short onsets, unsigned short beats, short rotation) {
-    unsigned long result = 0L;
+static void bjorklund(pattern *result, unsigned short onsets, unsigned short beats) {
+    repeats g = {onsets, {{1ULL << (WORD_BEATS - 1)}}, 1};
+    repeats r = {beats - onsets, {{0}}, 1};
+    er(&g, &r);
 
-    if (beats == 0) {
-        fprintf(stderr, "number of beats can't be zero\n");
-        result = 0;
-    } else if (onsets == 0) {
-        result = 0;
-    } else if (onsets > beats) {
-        fprintf(stderr,
-                "number of onsets (%d) can't be larger than number of beats (%d)\n",
-                onsets, beats);
-        for (unsigned short i = 0; i < beats; ++i) {
-            result <<= 1;
-            result |= 1;
+    unsigned short length = g.s;
+    *result = g.v;
+    for (unsigned short i = 1; i < g.n; ++i) {
+        or_later(result, &g.v, length);
+        length += g.s;
+    }
+    if (r.n > 0) {
+        or_later(result, &r.v, length);
+    }
+}
+
+// Fill the table once, when the shared object is loaded, so that no pattern is ever computed in `run()`
+__attribute__((constructor))
+static void build_patterns(void) {
+    for (unsigned short beats = 1; beats <= WORD_BEATS; ++beats) {
+        const uint64_t all_beats = ~0ULL >> (WORD_BEATS - beats);
+        for (unsigned short onsets = 1; onsets <= WORD_BEATS; ++onsets) {
+            if (onsets >= beats) {
+                patterns[beats][onsets] = all_beats;
+            } else {
+                pattern p;
+                bjorklund(&p, onsets, beats);
+                patterns[beats][onsets] = p.w[0] >> (WORD_BEATS - beats);
+            }
         }
+    }
+}
+
+uint64_t rotate(uint64_t pattern, unsigned short beats, short rotation) {
+    // `beats` must be in [1, WORD_BEATS]; normalise the rotation to [0, beats)
+    const unsigned short r = (unsigned short) (((rotation % beats) + beats) % beats);
+    const uint64_t mask = ~0ULL >> (WORD_BEATS - beats);
+
+    // the second shift is split in two so that it never reaches 64 when r == 0
+    return ((pattern << r) | ((pattern >> (beats - r - 1)) >> 1)) & mask;
+}
+
+uint64_t e(unsigned short onsets, unsigned short beats, short rotation) {
+    if (beats == 0) {
+        return 0;
+    }
+    if (beats > WORD_BEATS) beats = WORD_BEATS;
+    if (onsets > WORD_BEATS) onsets = WORD_BEATS;
+
+    return rotate(patterns[beats][onsets], beats, rotation);
+}
+
+void pattern_euclidean(pattern *p, unsigned short onsets, unsigned short beats, short rotation) {
+    memset(p, 0, sizeof(pattern));
+    if (beats == 0) {
+        return;
+    }
+    if (beats > MAX_BEATS) beats = MAX_BEATS;
+
+    if (beats <= WORD_BEATS) {
+        p->w[0] = e(onsets, beats, rotation) << (WORD_BEATS - beats);
+    } else if (onsets >= beats) {
+        memset(p, 0xff, sizeof(pattern));
+        truncate_pattern(p, beats);
     } else {
-        repeats g = {onsets, 0b1, 1};
-        repeats r = {beats - onsets, 0b0, 1};
-        er(&g, &r);
-
-        result = g.v;
-        for (unsigned short i = 1; i < g.n; ++i) {
-            result <<= g.s;
-            result |= g.v;
-        }
-        if (r.n > 0) {
-            result <<= r.s;
-            result |= r.v;
-        }
+        if (onsets > 0) bjorklund(p, onsets, beats);
+        pattern_rotate(p, beats, rotation);
+    }
+}
+
+void pattern_rotate(pattern *p, unsigned short beats, short rotation) {
+    if (beats == 0) {
+        return;
     }
-    for (int i = 0; i < rotation; ++i) {
-        unsigned short lowBit = (result & 1 << (beats - 1)) >> (beats - 1);
-        result &= (long) -1 ^ 1 << (beats - 1);
-        result <<= 1;
-        result |= lowBit;
+    const unsigned short r = (unsigned short) (((rotation % beats) + beats) % beats);
+    const pattern src = *p;
+
+    memset(p, 0, sizeof(pattern));
+    or_earlier(p, &src, r);
+    or_later(p, &src, beats - r);
+    truncate_pattern(p, beats);
+}
+
+unsigned short pattern_count(const pattern *p) {
+    unsigned short count = 0;
+    for (unsigned short j = 0; j < PATTERN_WORDS; ++j) {
+        count += __builtin_popcountll(p->w[j]);
     }
-    for (int i = 0; i > rotation; --i) {
-        unsigned long highBit = (result & 1) << (beats - 1);
-        result >>= 1;
-        result |= highBit;
+    return count;
+}
+
+// Returns the first onset at or after `from`, or `beats` if there is none
+unsigned short pattern_next(const pattern *p, unsigned short beats, unsigned short from) {
+    if (from >= beats) {
+        return beats;
     }
-    return result;
-}
\ No newline at end of file
+    unsigned short j = from / WORD_BEATS;
+    uint64_t w = p->w[j] & (~0ULL >> (from % WORD_BEATS));
+    while (w == 0) {
+        if (++j == PATTERN_WORDS) {
+            return beats;
+        }
+        w = p->w[j];
+    }
+    const unsigned short next = j * WORD_BEATS + __builtin_clzll(w);
+    return next < beats ? next : beats;
+}
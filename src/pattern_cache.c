@@ -0,0 +1,212 @@
+/*
+ * Copyright 2023, 2024 by Bruno Unna.
+ *
+ * This file is part of Euclidean Rhythms.
+ *
+ * Euclidean Rhythms is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * Euclidean Rhythms is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with Euclidean Rhythms.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pattern_cache.h"
+
+// The cache is an open-addressing hash table of entries, shared by every instance in the process. Slots are only
+// ever changed with compare-and-swap, so nobody waits for anybody. Entries pushed out of it (to make room when it's
+// full) go to the retired list, because an instance may still be reading them, until pattern_cache_collect() finds
+// them unborrowed.
+#define CACHE_SLOTS 4096
+#define MAX_PROBES 16
+
+static Pattern_entry *slots[CACHE_SLOTS];
+static Pattern_entry *retired;
+static unsigned acquiring;  // lookups under way, which may be about to borrow an entry just retired
+
+static unsigned hash(unsigned short onsets, unsigned short beats, short rotation) {
+    uint32_t h = ((uint32_t) beats << 20) ^ ((uint32_t) onsets << 10) ^ (uint16_t) rotation;
+    h *= 0x9E3779B1u;
+    return h >> 20;
+}
+
+// Where to look for a pattern that isn't Euclidean, from its beats and the pattern itself
+static unsigned hash_pattern(const pattern *p, unsigned short beats) {
+    uint64_t h = beats;
+    for (unsigned short j = 0; j < PATTERN_WORDS; ++j) {
+        h = (h ^ p->w[j]) * 0x9E3779B97F4A7C15ULL;
+    }
+    return (unsigned) (h >> 52);
+}
+
+static bool matches(const Pattern_entry *entry, unsigned short onsets, unsigned short beats, short rotation,
+                    const pattern *derived) {
+    if (derived != NULL) {
+        return entry->derived && entry->beats == beats && memcmp(&entry->euclidean, derived, sizeof(pattern)) == 0;
+    }
+    return !entry->derived && entry->onsets == onsets && entry->beats == beats && entry->rotation == rotation;
+}
+
+static void retire(Pattern_entry *entry) {
+    Pattern_entry *head = __atomic_load_n(&retired, __ATOMIC_RELAXED);
+    do {
+        entry->retired_next = head;
+    } while (!__atomic_compare_exchange_n(&retired, &head, entry, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+void pattern_entry_fill(Pattern_entry *entry, const pattern *p, unsigned short onsets, unsigned short beats,
+                        short rotation, bool derived) {
+    entry->retired_next = NULL;
+    entry->references = 1;
+    entry->onsets = onsets;
+    entry->beats = beats;
+    entry->rotation = rotation;
+    entry->derived = derived;
+    entry->euclidean = *p;
+
+    int j = 0;
+    for (unsigned short i = pattern_next(p, beats, 0); i < beats; i = pattern_next(p, beats, i + 1)) {
+        entry->steps[j++] = i;
+    }
+    entry->steps[j] = NO_ONSET;
+}
+
+static Pattern_entry *compute_entry(unsigned short onsets, unsigned short beats, short rotation,
+                                    const pattern *known, bool derived) {
+    pattern euclidean;
+    if (known != NULL) {
+        euclidean = *known;
+    } else {
+        pattern_euclidean(&euclidean, onsets, beats, rotation);
+    }
+
+    Pattern_entry *entry = malloc(sizeof(Pattern_entry) + (pattern_count(&euclidean) + 1) * sizeof(unsigned short));
+    if (entry != NULL) {
+        pattern_entry_fill(entry, &euclidean, onsets, beats, rotation, derived);
+    }
+    return entry;
+}
+
+// Look for an entry from slot `first` on, and put a new one there if it isn't found. A derived entry is looked for
+// by its pattern, `known`.
+static const Pattern_entry *acquire(unsigned first, unsigned short onsets, unsigned short beats, short rotation,
+                                    const pattern *known, bool derived) {
+    Pattern_entry *fresh = NULL;
+
+    for (;;) {
+        // Look for the pattern, and for somewhere to put it if it isn't there
+        int empty = -1, unused = -1;
+        for (unsigned probe = 0; probe < MAX_PROBES; ++probe) {
+            const unsigned slot = (first + probe) % CACHE_SLOTS;
+            Pattern_entry *entry = __atomic_load_n(&slots[slot], __ATOMIC_ACQUIRE);
+            if (entry == NULL) {
+                empty = (int) slot;
+                break;
+            }
+            if (matches(entry, onsets, beats, rotation, derived ? known : NULL)) {
+                __atomic_fetch_add(&entry->references, 1, __ATOMIC_RELAXED);
+                free(fresh);
+                return entry;
+            }
+            if (unused < 0 && __atomic_load_n(&entry->references, __ATOMIC_RELAXED) == 0) {
+                unused = (int) slot;
+            }
+        }
+
+        if (fresh == NULL) {
+            fresh = compute_entry(onsets, beats, rotation, known, derived);
+            if (fresh == NULL) {
+                return NULL;
+            }
+        }
+
+        if (empty >= 0) {
+            Pattern_entry *expected = NULL;
+            if (__atomic_compare_exchange_n(&slots[empty], &expected, fresh, false, __ATOMIC_RELEASE,
+                                            __ATOMIC_RELAXED)) {
+                return fresh;
+            }
+        } else if (unused >= 0) {
+            Pattern_entry *victim = __atomic_load_n(&slots[unused], __ATOMIC_ACQUIRE);
+            if (__atomic_compare_exchange_n(&slots[unused], &victim, fresh, false, __ATOMIC_SEQ_CST,
+                                            __ATOMIC_RELAXED)) {
+                if (__atomic_load_n(&victim->references, __ATOMIC_SEQ_CST) == 0) {
+                    retire(victim);
+                    return fresh;
+                }
+                // somebody borrowed the victim after all: it goes back, if the slot is still ours
+                Pattern_entry *expected = fresh;
+                if (!__atomic_compare_exchange_n(&slots[unused], &expected, victim, false, __ATOMIC_RELEASE,
+                                                 __ATOMIC_RELAXED)) {
+                    retire(victim);
+                    return fresh;
+                }
+            }
+        } else {
+            // every slot around is in use: the entry goes unshared
+            retire(fresh);
+            return fresh;
+        }
+        // somebody else changed the slot meanwhile, maybe to this very pattern
+    }
+}
+
+const Pattern_entry *pattern_cache_acquire(unsigned short onsets, unsigned short beats, short rotation,
+                                           const pattern *known) {
+    if (beats > MAX_BEATS) beats = MAX_BEATS;
+    __atomic_add_fetch(&acquiring, 1, __ATOMIC_SEQ_CST);
+    const Pattern_entry *entry = acquire(hash(onsets, beats, rotation), onsets, beats, rotation, known, false);
+    __atomic_sub_fetch(&acquiring, 1, __ATOMIC_SEQ_CST);
+    return entry;
+}
+
+const Pattern_entry *pattern_cache_acquire_pattern(const pattern *p, unsigned short beats) {
+    if (beats > MAX_BEATS) beats = MAX_BEATS;
+    __atomic_add_fetch(&acquiring, 1, __ATOMIC_SEQ_CST);
+    const Pattern_entry *entry = acquire(hash_pattern(p, beats), pattern_count(p), beats, 0, p, true);
+    __atomic_sub_fetch(&acquiring, 1, __ATOMIC_SEQ_CST);
+    return entry;
+}
+
+void pattern_cache_release(const Pattern_entry *entry) {
+    if (entry != NULL) {
+        __atomic_fetch_sub(&((Pattern_entry *) entry)->references, 1, __ATOMIC_RELEASE);
+    }
+}
+
+// A lookup that began before an entry was retired may still borrow it, so nothing is freed while any is under way.
+// Those that begin afterwards can't find it any more.
+void pattern_cache_collect(void) {
+    Pattern_entry *entry = __atomic_exchange_n(&retired, NULL, __ATOMIC_SEQ_CST);
+    const bool quiet = __atomic_load_n(&acquiring, __ATOMIC_SEQ_CST) == 0;
+    while (entry != NULL) {
+        Pattern_entry *next = entry->retired_next;
+        if (quiet && __atomic_load_n(&entry->references, __ATOMIC_ACQUIRE) == 0) {
+            free(entry);
+        } else {
+            retire(entry);
+        }
+        entry = next;
+    }
+}
+
+__attribute__((destructor))
+static void free_patterns(void) {
+    for (unsigned slot = 0; slot < CACHE_SLOTS; ++slot) {
+        free(slots[slot]);
+        slots[slot] = NULL;
+    }
+    while (retired != NULL) {
+        Pattern_entry *next = retired->retired_next;
+        free(retired);
+        retired = next;
+    }
+}
@@ -0,0 +1,262 @@
+/*
+ * Copyright 2023, 2024 by Bruno Unna.
+ *
+ * This file is part of Euclidean Rhythms.
+ *
+ * Euclidean Rhythms is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * Euclidean Rhythms is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with Euclidean Rhythms.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _XOPEN_SOURCE 600
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "pattern_db.h"
+
+// Words taken by a pattern of `beats` beats
+static unsigned short words_of(unsigned short beats) {
+    return (unsigned short) ((beats + WORD_BEATS - 1) / WORD_BEATS);
+}
+
+static unsigned short gcd(unsigned short a, unsigned short b) {
+    while (b != 0) {
+        const unsigned short t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Does `a` come after `b`, reading them beat by beat from the first one?
+static bool later(const pattern *a, const pattern *b, unsigned short words) {
+    for (unsigned short j = 0; j < words; ++j) {
+        if (a->w[j] != b->w[j]) {
+            return a->w[j] > b->w[j];
+        }
+    }
+    return false;
+}
+
+// Fill in what the database says about a pattern, besides where it is
+static void describe(Pattern_db_record *record, const pattern *p, unsigned short onsets, unsigned short beats) {
+    const unsigned short words = words_of(beats);
+    record->onsets = onsets;
+    record->beats = beats;
+
+    // A Euclidean pattern repeats itself every beats / gcd(beats, onsets) beats
+    record->period = (uint16_t) (beats / gcd(beats, onsets));
+
+    // The representative of the necklace is the rotation that comes last in lexicographic order
+    pattern best = *p;
+    record->canonical_rotation = 0;
+    for (unsigned short r = 1; r < record->period; ++r) {
+        pattern q = *p;
+        pattern_rotate(&q, beats, (short) r);
+        if (later(&q, &best, words)) {
+            best = q;
+            record->canonical_rotation = r;
+        }
+    }
+
+    // Pairs of onsets `d` beats apart are those that the pattern, rotated `d` places, has in common with itself. They
+    // are as many as those `beats - d` apart, and just as far from each other on the circle.
+    double chords = 0;
+    for (unsigned short d = 1; d <= beats / 2; ++d) {
+        pattern q = *p;
+        pattern_rotate(&q, beats, (short) d);
+        unsigned pairs = 0;
+        for (unsigned short j = 0; j < words; ++j) {
+            pairs += (unsigned) __builtin_popcountll(p->w[j] & q.w[j]);
+        }
+        chords += (2 * d == beats ? 1 : 2) * pairs * sin(M_PI * d / beats);
+    }
+    record->evenness = onsets > 1 ? (float) (chords / ((double) onsets * (onsets - 1))) : 0;
+
+    double squares = 0;
+    if (onsets > 0) {
+        const double mean = (double) beats / onsets;
+        const unsigned short first = pattern_next(p, beats, 0);
+        unsigned short previous = first;
+        for (unsigned short i = pattern_next(p, beats, first + 1); i < beats; i = pattern_next(p, beats, i + 1)) {
+            squares += (i - previous - mean) * (i - previous - mean);
+            previous = i;
+        }
+        squares += (beats - previous + first - mean) * (beats - previous + first - mean);
+        squares /= onsets;
+    }
+    record->deviation = (float) sqrt(squares);
+}
+
+bool pattern_db_build(const char *path, unsigned short max_beats) {
+    if (max_beats < 1 || max_beats > MAX_BEATS) {
+        return false;
+    }
+
+    uint64_t n_words = 0;
+    for (unsigned short beats = 1; beats <= max_beats; ++beats) {
+        n_words += (uint64_t) (beats + 1) * words_of(beats);
+    }
+    const uint32_t n_records = PATTERN_DB_RECORDS(max_beats);
+    Pattern_db_record *records = calloc(n_records, sizeof(Pattern_db_record));
+    uint64_t *words = calloc(n_words, sizeof(uint64_t));
+    if (!records || !words) {
+        free(records);
+        free(words);
+        return false;
+    }
+
+    uint32_t index = 0;
+    uint64_t word = 0;
+    for (unsigned short beats = 1; beats <= max_beats; ++beats) {
+        for (unsigned short onsets = 0; onsets <= beats; ++onsets) {
+            pattern p;
+            pattern_euclidean(&p, onsets, beats, 0);
+            describe(&records[index], &p, onsets, beats);
+            records[index].necklace = index;
+            records[index].word = (uint32_t) word;
+            memcpy(&words[word], p.w, words_of(beats) * sizeof(uint64_t));
+            word += words_of(beats);
+            index++;
+        }
+    }
+
+    Pattern_db_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PATTERN_DB_MAGIC, sizeof(header.magic));
+    header.version = PATTERN_DB_VERSION;
+    header.byte_order = PATTERN_DB_BYTE_ORDER;
+    header.max_beats = max_beats;
+    header.n_records = n_records;
+    header.words_offset = sizeof(header) + (uint64_t) n_records * sizeof(Pattern_db_record);
+    header.size = header.words_offset + n_words * sizeof(uint64_t);
+
+    FILE *file = fopen(path, "wb");
+    bool written = file != NULL &&
+                   fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   fwrite(records, sizeof(Pattern_db_record), n_records, file) == n_records &&
+                   fwrite(words, sizeof(uint64_t), n_words, file) == n_words;
+    if (file != NULL && fclose(file) != 0) {
+        written = false;
+    }
+
+    free(records);
+    free(words);
+    return written;
+}
+
+// Is what has been mapped a database that this build can read?
+static bool usable(const void *map, size_t size) {
+    const Pattern_db_header *header = (const Pattern_db_header *) map;
+    return size >= sizeof(Pattern_db_header) &&
+           memcmp(header->magic, PATTERN_DB_MAGIC, sizeof(header->magic)) == 0 &&
+           header->version == PATTERN_DB_VERSION &&
+           header->byte_order == PATTERN_DB_BYTE_ORDER &&
+           header->max_beats >= 1 && header->max_beats <= MAX_BEATS &&
+           header->n_records == PATTERN_DB_RECORDS(header->max_beats) &&
+           header->words_offset == sizeof(Pattern_db_header) + (uint64_t) header->n_records * sizeof(Pattern_db_record) &&
+           header->size == size && size >= header->words_offset;
+}
+
+bool pattern_db_open(Pattern_db *db, const char *bundle_path) {
+    memset(db, 0, sizeof(Pattern_db));
+#if defined(_WIN32)
+    (void) bundle_path;
+    return false;
+#else
+    if (bundle_path == NULL) {
+        return false;
+    }
+    const size_t length = strlen(bundle_path);
+    char *path = malloc(length + sizeof(PATTERN_DB_FILE) + 1);
+    if (!path) {
+        return false;
+    }
+    strcpy(path, bundle_path);
+    if (length > 0 && bundle_path[length - 1] != '/') {
+        strcat(path, "/");
+    }
+    strcat(path, PATTERN_DB_FILE);
+
+    const int fd = open(path, O_RDONLY);
+    free(path);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat status;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &status) == 0 && status.st_size > 0) {
+        map = mmap(NULL, (size_t) status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    if (!usable(map, (size_t) status.st_size)) {
+        munmap(map, (size_t) status.st_size);
+        return false;
+    }
+
+    db->map = map;
+    db->size = (size_t) status.st_size;
+    db->header = (const Pattern_db_header *) map;
+    db->records = (const Pattern_db_record *) (db->header + 1);
+    db->words = (const uint64_t *) ((const char *) map + db->header->words_offset);
+    db->n_words = (db->size - db->header->words_offset) / sizeof(uint64_t);
+    return true;
+#endif
+}
+
+void pattern_db_close(Pattern_db *db) {
+#if !defined(_WIN32)
+    if (db->map != NULL) {
+        munmap(db->map, db->size);
+    }
+#endif
+    memset(db, 0, sizeof(Pattern_db));
+}
+
+const Pattern_db_record *pattern_db_record(const Pattern_db *db, unsigned short onsets, unsigned short beats) {
+    if (db->header == NULL || beats < 1 || beats > db->header->max_beats) {
+        return NULL;
+    }
+    // as many onsets as beats, or more, is a beat on every beat
+    if (onsets > beats) onsets = beats;
+
+    const Pattern_db_record *record = &db->records[(uint32_t) (beats - 1) * (beats + 2) / 2 + onsets];
+    if (record->onsets != onsets || record->beats != beats ||
+        (uint64_t) record->word + words_of(beats) > db->n_words) {
+        return NULL;
+    }
+    return record;
+}
+
+bool pattern_db_find(const Pattern_db *db, unsigned short onsets, unsigned short beats, short rotation, pattern *p) {
+    const Pattern_db_record *record = pattern_db_record(db, onsets, beats);
+    if (record == NULL) {
+        return false;
+    }
+    memset(p, 0, sizeof(pattern));
+    memcpy(p->w, &db->words[record->word], words_of(beats) * sizeof(uint64_t));
+    if (rotation % beats != 0) {
+        pattern_rotate(p, beats, rotation);
+    }
+    return true;
+}
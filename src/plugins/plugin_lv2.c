@@ -15,160 +15,656 @@
  * If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <limits.h>
+#include <math.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#if !defined(_WIN32)
+#include <sched.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include <lv2/lv2plug.in/ns/ext/atom/atom.h>
 #include <lv2/lv2plug.in/ns/ext/atom/forge.h>
 #include <lv2/lv2plug.in/ns/ext/log/logger.h>
 #include <lv2/lv2plug.in/ns/ext/midi/midi.h>
+#include <lv2/lv2plug.in/ns/ext/state/state.h>
+#include <lv2/lv2plug.in/ns/ext/worker/worker.h>
 #include <lv2/lv2plug.in/ns/lv2core/lv2.h>
 #include <lv2/lv2plug.in/ns/lv2core/lv2_util.h>
 
 #include "euclidean.h"
 #include "lv2_uris.h"
+#include "pattern_cache.h"
+#include "pattern_db.h"
+#include "rt_log.h"
+
+// A pattern, borrowed from the cache, together with what is needed to lay it out in time
+typedef struct {
+    const Pattern_entry *entry;
+    unsigned short size_in_bars;
+} Pattern_layout;
+
+// What the audio thread asks the worker to compute...
+typedef struct {
+    unsigned short generator;
+    unsigned short serial;
+    unsigned short onsets;
+    unsigned short beats;
+    short rotation;
+    unsigned short size_in_bars;
+    unsigned short combination;     // of the patterns of two generators, or COMBINE_NONE...
+    struct {
+        unsigned short onsets;
+        unsigned short beats;
+        short rotation;
+    } sources[2];                   // ...which have these parameters
+} Pattern_request;
+
+// ...and what it gets back
+typedef struct {
+    unsigned short generator;
+    unsigned short serial;
+    Pattern_layout layout;
+} Pattern_response;
+
+// The lanes of a generator, as planes of bits laid out like its pattern. A step takes its value in a lane from a bit
+// of each of the planes of the lane, the first plane giving the lowest bit.
+typedef struct {
+    pattern accent;
+    pattern probability[2];
+    pattern level[2];
+} Lanes;
+
+// What the state extension saves: the parameters of every generator, its lanes, and the pattern computed from them
+// when it is up to date (only to check them against, when restored), in a single chunk
+#define SNAPSHOT_VERSION 1
+
+typedef struct {
+    uint16_t beats;
+    uint16_t onsets;
+    int16_t rotation;
+    uint16_t size_in_bars;
+    uint8_t enabled;
+    uint8_t channel;    // 0 to 15
+    uint8_t note;
+    uint8_t velocity;
+    uint8_t has_pattern;
+    uint16_t gate;
+    uint8_t swing;
+    uint8_t timing;
+    uint8_t dynamics;
+    pattern euclidean;
+    Lanes lanes;
+    uint8_t combination;
+    uint8_t first;
+    uint8_t second;
+} Generator_snapshot;
+
+typedef struct {
+    uint32_t version;
+    uint32_t n_generators;
+    Generator_snapshot generators[N_GENERATORS];
+} Snapshot;
+
+// Asks the worker to empty the log, and tells the audio thread that it has been emptied. Its size tells it apart
+// from the patterns.
+typedef struct {
+    uint8_t flush;
+} Log_flush;
+
+// What the audio thread logs...
+typedef enum {
+    LOG_CONTROL_PORT,
+    LOG_MIDI_PORT,
+    LOG_NOTIFY_PORT,
+    LOG_ENABLED_PORT,
+    LOG_BEATS_PORT,
+    LOG_ONSETS_PORT,
+    LOG_ROTATION_PORT,
+    LOG_BARS_PORT,
+    LOG_CHANNEL_PORT,
+    LOG_NOTE_PORT,
+    LOG_VELOCITY_PORT,
+    LOG_GATE_PORT,
+    LOG_SWING_PORT,
+    LOG_TIMING_PORT,
+    LOG_DYNAMICS_PORT,
+    LOG_CLOCK_PORT,
+    LOG_TEMPO_PORT,
+    LOG_MISSING_PORT,
+    LOG_PATCH_GENERATOR,
+    LOG_ENABLED,
+    LOG_DISABLED,
+    LOG_BEATS,
+    LOG_ONSETS,
+    LOG_ROTATION,
+    LOG_BARS,
+    LOG_LANE,
+    LOG_COMBINATION,
+    LOG_FIRST,
+    LOG_SECOND,
+    LOG_TEMPO,
+    LOG_BEATS_PER_BAR,
+    LOG_RELOCATE,
+    LOG_INTERNAL_CLOCK,
+    LOG_HOST_CLOCK,
+} Log_code;
+
+// ...and how it reads once formatted, out of the audio thread. Real numbers travel as thousandths.
+typedef enum {
+    LOG_ARGS_VALUE,
+    LOG_ARGS_GENERATOR,
+    LOG_ARGS_GENERATOR_VALUE,
+    LOG_ARGS_REAL,
+} Log_arguments;
+
+typedef struct {
+    bool error;
+    Log_arguments arguments;
+    const char *format;
+} Log_message;
+
+static const Log_message log_messages[] = {
+        [LOG_CONTROL_PORT] = {false, LOG_ARGS_VALUE, "Setting control port %d\n"},
+        [LOG_MIDI_PORT] = {false, LOG_ARGS_VALUE, "Setting midi port %d\n"},
+        [LOG_NOTIFY_PORT] = {false, LOG_ARGS_VALUE, "Setting notify port %d\n"},
+        [LOG_ENABLED_PORT] = {false, LOG_ARGS_GENERATOR, "Setting port *enabled* of gen %d\n"},
+        [LOG_BEATS_PORT] = {false, LOG_ARGS_GENERATOR, "Setting port *beats* of gen %d\n"},
+        [LOG_ONSETS_PORT] = {false, LOG_ARGS_GENERATOR, "Setting port *onsets* of gen %d\n"},
+        [LOG_ROTATION_PORT] = {false, LOG_ARGS_GENERATOR, "Setting port *rotation* of gen %d\n"},
+        [LOG_BARS_PORT] = {false, LOG_ARGS_GENERATOR, "Setting port *bars* of gen %d\n"},
+        [LOG_CHANNEL_PORT] = {false, LOG_ARGS_GENERATOR, "Setting port *channel* of gen %d\n"},
+        [LOG_NOTE_PORT] = {false, LOG_ARGS_GENERATOR, "Setting port *note* of gen %d\n"},
+        [LOG_VELOCITY_PORT] = {false, LOG_ARGS_GENERATOR, "Setting port *velocity* of gen %d\n"},
+        [LOG_GATE_PORT] = {false, LOG_ARGS_GENERATOR, "Setting port *gate* of gen %d\n"},
+        [LOG_SWING_PORT] = {false, LOG_ARGS_GENERATOR, "Setting port *swing* of gen %d\n"},
+        [LOG_TIMING_PORT] = {false, LOG_ARGS_GENERATOR, "Setting port *timing* of gen %d\n"},
+        [LOG_DYNAMICS_PORT] = {false, LOG_ARGS_GENERATOR, "Setting port *dynamics* of gen %d\n"},
+        [LOG_CLOCK_PORT] = {false, LOG_ARGS_VALUE, "Setting clock port %d\n"},
+        [LOG_TEMPO_PORT] = {false, LOG_ARGS_VALUE, "Setting tempo port %d\n"},
+        [LOG_MISSING_PORT] = {true, LOG_ARGS_VALUE, "Trying to map missing port %d\n"},
+        [LOG_PATCH_GENERATOR] = {true, LOG_ARGS_VALUE, "Ignoring a patch message for missing generator %d\n"},
+        [LOG_ENABLED] = {false, LOG_ARGS_GENERATOR, "[gen %d] plugin status set to enabled\n"},
+        [LOG_DISABLED] = {false, LOG_ARGS_GENERATOR, "[gen %d] plugin status set to disabled\n"},
+        [LOG_BEATS] = {false, LOG_ARGS_GENERATOR_VALUE, "[gen %d] plugin beats per bar set to %d\n"},
+        [LOG_ONSETS] = {false, LOG_ARGS_GENERATOR_VALUE, "[gen %d] plugin onsets set to %d\n"},
+        [LOG_ROTATION] = {false, LOG_ARGS_GENERATOR_VALUE, "[gen %d] plugin rotation set to %d\n"},
+        [LOG_BARS] = {false, LOG_ARGS_GENERATOR_VALUE, "[gen %d] size of the pattern (in bars) set to %d\n"},
+        [LOG_LANE] = {false, LOG_ARGS_GENERATOR_VALUE, "[gen %d] lane %d set\n"},
+        [LOG_COMBINATION] = {false, LOG_ARGS_GENERATOR_VALUE, "[gen %d] combination set to %d\n"},
+        [LOG_FIRST] = {false, LOG_ARGS_GENERATOR_VALUE, "[gen %d] first generator combined set to %d\n"},
+        [LOG_SECOND] = {false, LOG_ARGS_GENERATOR_VALUE, "[gen %d] second generator combined set to %d\n"},
+        [LOG_TEMPO] = {false, LOG_ARGS_REAL, "tempo changed to %.3f bpm\n"},
+        [LOG_BEATS_PER_BAR] = {false, LOG_ARGS_REAL,
+                               "relocating the generators because beats per bar changed to %.3f\n"},
+        [LOG_RELOCATE] = {false, LOG_ARGS_REAL, "relocating the generators to beat %.3f\n"},
+        [LOG_INTERNAL_CLOCK] = {false, LOG_ARGS_REAL, "keeping time by ourselves, at beat %.3f\n"},
+        [LOG_HOST_CLOCK] = {false, LOG_ARGS_VALUE, "following the transport of the host again\n"},
+};
+
+// A note waiting to be switched off
+typedef struct {
+    long frame;
+    uint8_t channel;
+    uint8_t note;
+} Note_off;
+
+// How many notes can be sounding at once. Onsets beyond that are missed.
+#define NOTE_OFF_CAPACITY 256
 
 typedef struct {
     LV2_URID_Map *map;     // URID map feature
+    LV2_Worker_Schedule *schedule; // Worker feature (optional)
     LV2_Log_Logger logger; // Logger API
     Euclidean_URIs uris;    // Cache of mapped URIDs
 
     struct {
         LV2_Atom_Sequence *control;
-        float *enabled[N_GENERATORS];
-        float *beats[N_GENERATORS];
-        float *onsets[N_GENERATORS];
-        float *rotation[N_GENERATORS];
-        float *bars[N_GENERATORS];
-        float *channel[N_GENERATORS];
-        float *note[N_GENERATORS];
-        float *velocity[N_GENERATORS];
+        float *parameters[N_PROPERTIES][N_GENERATORS];  // by the index of the parameter (from the gate on, optional)
         LV2_Atom_Sequence *midi_out;
+        LV2_Atom_Sequence *notify;  // optional
+        float *clock;               // optional
+        float *tempo;               // optional
+
+        // What each control port was the last time we looked (NaN before the first block). A port only changes its
+        // parameter when it moves, so that it doesn't undo what patch messages did.
+        float seen[N_PROPERTIES][N_GENERATORS];
     } ports;
 
+    LV2_Atom_Forge forge;   // for the notify port
+
+    Pattern_db database;    // of precomputed patterns, mapped from the bundle (empty if it isn't there)
+
+    // what happened in run() since it was last published on the notify port
+    struct {
+        uint32_t frames;
+        uint32_t blocks;
+        uint64_t cycles;
+        uint64_t worst_cycles;
+        uint32_t events;
+        uint32_t dropped_events;
+        uint32_t recalculations;
+        uint32_t late_onsets;
+        uint32_t missed_onsets;
+    } telemetry;
+
     // this state is common to all generators
     struct {
         float speed;
         float beats_per_minute;
         float beats_per_bar;
         long current_bar;
+        long frame;     // transport frame at the point of the block being processed, -1 if still unknown
         float frames_per_second;
+
+        // The musical time (in beats) of the transport is worked out from the last point where it was known for sure,
+        // so that errors don't pile up from one block to the next
+        long anchor_frame;
+        double anchor_beat;
+        double frames_per_beat; // 0 while the tempo is unknown
+
+        // Whether the transport is our own, rather than the host's, in which case the host's positions are ignored
+        bool internal_clock;
     } common_state;
 
-    // this state is particular to each generator
+    // one bit per generator whose onsets have to be listed again before they can be played
+    uint64_t dirty;
+
+    // this state is particular to each generator, laid out one array per field (or one bit per generator) so that
+    // looking at all the generators at once touches as little memory as possible
     struct {
-        bool enabled;
+        long next_on[N_GENERATORS];     // frame of the next note on, LONG_MAX if there is none
+        double next_on_beat[N_GENERATORS];  // ...and its musical time
+        uint64_t enabled;
 
-        unsigned short beats;
-        unsigned short onsets;
-        short rotation;
-        unsigned short size_in_bars;
+        // the parameters of the pattern, as the ports or patch messages last set them
+        unsigned short beats[N_GENERATORS];
+        unsigned short onsets[N_GENERATORS];
+        short rotation[N_GENERATORS];
+        unsigned short size_in_bars[N_GENERATORS];
 
-        unsigned long euclidean;
+        unsigned short serial[N_GENERATORS];  // of the latest request sent to the worker
+        unsigned short active_serial[N_GENERATORS];  // ...and of the one the active layout answered
+        unsigned short pending_serial[N_GENERATORS]; // ...and the pending one
+        uint64_t has_pending;
 
-        long current_bar;
-        long reference_frame;
-        unsigned short note_on_index;
-        unsigned short note_off_index;
-        long *note_on_vector;
-        long *note_off_vector;
-
-        unsigned short playing;
-    } state[N_GENERATORS];
+        // Pending layouts wait for the next repetition of the pattern being played to take over, so that edits land
+        // on the boundaries of the pattern: one bit per generator with one waiting, and the beat where it takes over
+        uint64_t swapping;
+        double swap_beat[N_GENERATORS];
+
+        long repetition[N_GENERATORS];  // of the pattern, counting from the start of the song
+        unsigned short note_on_index[N_GENERATORS];
+
+        // what to play
+        uint8_t channel[N_GENERATORS];
+        uint8_t note[N_GENERATORS];
+        uint8_t velocity[N_GENERATORS];
+        unsigned short gate[N_GENERATORS];
+
+        // how it grooves, and what that does to each step of the grid: how far (in steps) it is moved, and how much
+        // louder or softer it is played. Worked out when the groove changes, so that playing a note only looks it up.
+        uint8_t swing[N_GENERATORS];
+        uint8_t timing[N_GENERATORS];
+        uint8_t dynamics[N_GENERATORS];
+        float step_offset[N_GENERATORS][MAX_BEATS];
+        int8_t velocity_offset[N_GENERATORS][MAX_BEATS];
+
+        // what its lanes say about each step, and the steps that the probability lane leaves out of the repetition
+        // it was last drawn for
+        Lanes lanes[N_GENERATORS];
+        pattern dropped[N_GENERATORS];
+        long drawn_repetition[N_GENERATORS];
+
+        // how it combines the patterns of two generators instead of having one of its own, if it does
+        uint8_t combination[N_GENERATORS];
+        uint8_t first[N_GENERATORS];
+        uint8_t second[N_GENERATORS];
+
+        // the layouts being played, and the ones computed by the worker that will replace them at the end of the cycle
+        Pattern_layout active[N_GENERATORS];
+        Pattern_layout pending[N_GENERATORS];
+
+        // a copy of the pattern of each active layout, for save() to read: the entry itself may be released, and
+        // freed or computed over, while save() is at it
+        pattern active_pattern[N_GENERATORS];
+    } state;
+
+    RT_log log;            // what the audio thread has to say, waiting to be formatted elsewhere
+    bool log_flush_requested;
+
+    // Bumped by the audio thread before and after it changes what save() reads (odd while it's at it), so that
+    // save() can tell whether it read something half changed. Waiting patterns are swapped in from so many places
+    // (while rendering, relocating, laying out onsets) that it is odd for the whole of run() and end_run().
+    uint32_t changes;
+
+    // The notes sounding, as a binary heap with the first to be switched off on top, and where in the heap each
+    // channel and note is (plus one, or 0 if it isn't sounding)
+    struct {
+        Note_off heap[NOTE_OFF_CAPACITY];
+        uint16_t count;
+        uint16_t position[16][128];
+    } sounding;
+
+    // A snapshot restored by the host, and its patterns, to be applied by the audio thread at the start of the next block
+    Snapshot restored;
+    const Pattern_entry *restored_entries[N_GENERATORS];
+
+    // Two entries of its own for each generator, for the patterns that the audio thread computes when there is no
+    // worker to do it (the cache would allocate memory), out of a single block
+    Pattern_entry *own_entries[N_GENERATORS][2];
+    void *own_memory;
+    bool restore_pending;
 } Euclidean;
 
+typedef struct {
+    LV2_Atom_Event event;
+    uint8_t msg[3];
+} MIDI_note_event;
+
+// A note event takes exactly the room it takes in a sequence, padding included, so an array of them is already laid
+// out as the events of a sequence
+typedef char MIDI_note_event_is_padded[sizeof(MIDI_note_event) == sizeof(LV2_Atom_Event) + 8 ? 1 : -1];
+
+// Notes of a block, collected on the stack while they are rendered, and written to the output a batch at a time
+#define BATCH_CAPACITY 128
+
+typedef struct {
+    uint32_t capacity;  // of the output sequence
+    uint32_t count;
+    MIDI_note_event notes[BATCH_CAPACITY];
+} Note_batch;
+
+// One bit per generator, as used by masks like `dirty`
+#define ALL_GENERATORS (~0ULL >> (64 - N_GENERATORS))
+
+// How far (in frames) the host's idea of where the transport is may drift from ours before we follow the host
+#define RESYNC_TOLERANCE 8
+
+// Queue a message for the log, to be formatted out of the audio thread
+static inline void trace(Euclidean *self, Log_code code, unsigned short generator, int64_t value) {
+    rt_log_push(&self->log, code, generator, value);
+}
+
+// Hosts may connect the ports again before every block, only new connections are worth a message
+static inline void trace_connection(Euclidean *self, Log_code code, unsigned short generator, const void *connected,
+                                    const void *data) {
+    if (connected != data) {
+        trace(self, code, generator, 0);
+    }
+}
+
+// The messages about the ports of a generator come in the order of its parameters
+static void connect_parameter(Euclidean *self, unsigned parameter, unsigned short generator, void *data) {
+    trace_connection(self, (Log_code) (LOG_ENABLED_PORT + parameter), generator,
+                     self->ports.parameters[parameter][generator], data);
+    self->ports.parameters[parameter][generator] = (float *) data;
+}
+
 static void connect_port(LV2_Handle instance, uint32_t port, void *data) {
     Euclidean *self = (Euclidean *) instance;
 
     if (port == CONTROL_PORT) {
-        lv2_log_trace(&self->logger, "Setting control port %d\n", port);
+        if (self->ports.control != data) {
+            trace(self, LOG_CONTROL_PORT, 0, port);
+        }
         self->ports.control = (LV2_Atom_Sequence *) data;
     } else if (port == MIDI_OUT_PORT) {
-        lv2_log_trace(&self->logger, "Setting midi port %d\n", port);
+        if (self->ports.midi_out != data) {
+            trace(self, LOG_MIDI_PORT, 0, port);
+        }
         self->ports.midi_out = (LV2_Atom_Sequence *) data;
+    } else if (port == NOTIFY_PORT) {
+        if (self->ports.notify != data) {
+            trace(self, LOG_NOTIFY_PORT, 0, port);
+        }
+        self->ports.notify = (LV2_Atom_Sequence *) data;
+    } else if (port == CLOCK_PORT) {
+        trace_connection(self, LOG_CLOCK_PORT, 0, self->ports.clock, data);
+        self->ports.clock = (float *) data;
+    } else if (port == TEMPO_PORT) {
+        trace_connection(self, LOG_TEMPO_PORT, 0, self->ports.tempo, data);
+        self->ports.tempo = (float *) data;
+    } else if (port >= GATE_PORT(0) && port < GATE_PORT(N_GENERATORS)) {
+        connect_parameter(self, GATE_IDX, (unsigned short) (port - GATE_PORT(0)), data);
+    } else if (port >= SWING_PORT(0) && port < SWING_PORT(N_GENERATORS)) {
+        connect_parameter(self, SWING_IDX + (port - SWING_PORT(0)) % 3, (unsigned short) ((port - SWING_PORT(0)) / 3),
+                          data);
     } else {
         unsigned short generator = (port - 2) / N_PARAMETERS;
         unsigned short widget_offset = (port - 2) % N_PARAMETERS;
-        switch (widget_offset) {
-            case ENABLED_IDX:
-                lv2_log_trace(&self->logger, "Setting port *enabled* of gen %d\n", generator);
-                self->ports.enabled[generator] = (float *) data;
-                break;
-            case BEATS_IDX:
-                lv2_log_trace(&self->logger, "Setting port *beats* of gen %d\n", generator);
-                self->ports.beats[generator] = (float *) data;
-                break;
-            case ONSETS_IDX:
-                lv2_log_trace(&self->logger, "Setting port *onsets* of gen %d\n", generator);
-                self->ports.onsets[generator] = (float *) data;
-                break;
-            case ROTATION_IDX:
-                lv2_log_trace(&self->logger, "Setting port *rotation* of gen %d\n", generator);
-                self->ports.rotation[generator] = (float *) data;
-                break;
-            case BARS_IDX:
-                lv2_log_trace(&self->logger, "Setting port *bars* of gen %d\n", generator);
-                self->ports.bars[generator] = (float *) data;
-                break;
-            case CHANNEL_IDX:
-                lv2_log_trace(&self->logger, "Setting port *channel* of gen %d\n", generator);
-                self->ports.channel[generator] = (float *) data;
-                break;
-            case NOTE_IDX:
-                lv2_log_trace(&self->logger, "Setting port *note* of gen %d\n", generator);
-                self->ports.note[generator] = (float *) data;
-                break;
-            case VELOCITY_IDX:
-                lv2_log_trace(&self->logger, "Setting port *velocity* of gen %d\n", generator);
-                self->ports.velocity[generator] = (float *) data;
-                break;
-            default:
-                lv2_log_error(&self->logger, "Trying to map missing port %d\n", port);
-                break;
+        if (generator >= N_GENERATORS) {
+            trace(self, LOG_MISSING_PORT, 0, port);
+            return;
         }
+        connect_parameter(self, widget_offset, generator, data);
     }
 }
 
-static void recalculate_onsets(Euclidean *self) {
-    const float fps = self->common_state.frames_per_second;
-    const float bpm = self->common_state.beats_per_minute;
-    const float beats_per_bar = self->common_state.beats_per_bar;
+// Frame at which the transport gets to a point of musical time, if the tempo stays as it is
+static long frame_at(const Euclidean *self, double beat) {
+    return self->common_state.anchor_frame +
+           lround((beat - self->common_state.anchor_beat) * self->common_state.frames_per_beat);
+}
 
-    // How many frames per bar?
-    const long frames_per_bar = (long) (60 * fps / bpm * beats_per_bar);
+// Musical time of the transport at a frame, if the tempo stays as it is
+static double beat_at(const Euclidean *self, long frame) {
+    return self->common_state.anchor_beat +
+           (double) (frame - self->common_state.anchor_frame) / self->common_state.frames_per_beat;
+}
 
-    // How many frames per MIDI tick (minimum sensible length of a note)?
-    const long frames_per_tick = (long) ((60 * fps) / (bpm * 24));
+// Musical time of the step of the grid where the onset a generator is pointing to is. Step `i` of a pattern of `n`
+// beats is exactly `i / n` of the way through the pattern, whatever the tempo.
+static double step_beat(const Euclidean *self, unsigned short gen) {
+    const Pattern_entry *entry = self->state.active[gen].entry;
+    const unsigned short beats = entry->beats;
+    const double pattern_beats = self->state.active[gen].size_in_bars * (double) self->common_state.beats_per_bar;
+    const unsigned short step = entry->steps[self->state.note_on_index[gen]];
+
+    return ((double) self->state.repetition[gen] * beats + step) * pattern_beats / beats;
+}
+
+// ...and of the onset itself, which the groove of the generator moves away from the grid
+static double onset_beat(const Euclidean *self, unsigned short gen) {
+    const Pattern_entry *entry = self->state.active[gen].entry;
+    const unsigned short beats = entry->beats;
+    const double pattern_beats = self->state.active[gen].size_in_bars * (double) self->common_state.beats_per_bar;
+    const unsigned short step = entry->steps[self->state.note_on_index[gen]];
+
+    return ((double) self->state.repetition[gen] * beats + step + self->state.step_offset[gen][step]) *
+           pattern_beats / beats;
+}
+
+// Can the onsets of a generator be placed in time at all?
+static bool playable(const Euclidean *self, unsigned short gen) {
+    return ((self->state.enabled & ~self->dirty) >> gen & 1) && self->common_state.frames_per_beat > 0 &&
+           self->common_state.beats_per_bar > 0 && self->state.active[gen].size_in_bars > 0 &&
+           self->state.active[gen].entry != NULL && self->state.active[gen].entry->steps[0] != NO_ONSET;
+}
+
+// Point a playable generator to the first of its onsets that hasn't been played yet
+static void find_onset(Euclidean *self, unsigned short gen) {
+    const long frame = self->common_state.frame;
+    const unsigned short *note_on = self->state.active[gen].entry->steps;
+    const double pattern_beats = self->state.active[gen].size_in_bars * (double) self->common_state.beats_per_bar;
 
+    self->state.repetition[gen] = (long) floor(beat_at(self, frame) / pattern_beats);
+    self->state.note_on_index[gen] = 0;
+    while (note_on[self->state.note_on_index[gen]] != NO_ONSET && frame_at(self, onset_beat(self, gen)) < frame) {
+        self->state.note_on_index[gen]++;
+    }
+    if (note_on[self->state.note_on_index[gen]] == NO_ONSET) {
+        self->state.repetition[gen]++;
+        self->state.note_on_index[gen] = 0;
+    }
+}
+
+// Point a playable generator to the first of its onsets on the grid from a point of musical time on
+static void find_onset_from(Euclidean *self, unsigned short gen, double beat) {
+    const unsigned short *note_on = self->state.active[gen].entry->steps;
+    const double pattern_beats = self->state.active[gen].size_in_bars * (double) self->common_state.beats_per_bar;
+
+    self->state.repetition[gen] = (long) floor(beat / pattern_beats);
+    self->state.note_on_index[gen] = 0;
+    while (note_on[self->state.note_on_index[gen]] != NO_ONSET && step_beat(self, gen) < beat) {
+        self->state.note_on_index[gen]++;
+    }
+    if (note_on[self->state.note_on_index[gen]] == NO_ONSET) {
+        self->state.repetition[gen]++;
+        self->state.note_on_index[gen] = 0;
+    }
+}
+
+// Keep the copy of the active pattern that save() reads up to date. An entry the cache couldn't allocate plays
+// nothing.
+static void copy_active_pattern(Euclidean *self, unsigned short gen) {
+    const Pattern_entry *entry = self->state.active[gen].entry;
+    if (entry != NULL) {
+        self->state.active_pattern[gen] = entry->euclidean;
+    } else {
+        memset(&self->state.active_pattern[gen], 0, sizeof(pattern));
+    }
+}
+
+// Hand a generator over to the layout computed for it. Its onsets have to be listed again.
+static void apply_pending_pattern(Euclidean *self, unsigned short gen) {
+    pattern_cache_release(self->state.active[gen].entry);
+    self->state.active[gen] = self->state.pending[gen];
+    self->state.active_serial[gen] = self->state.pending_serial[gen];
+    copy_active_pattern(self, gen);
+    self->state.has_pending &= ~(1ULL << gen);
+    self->state.swapping &= ~(1ULL << gen);
+    self->dirty |= 1ULL << gen;
+}
+
+// Hand a generator over to the layout waiting for its turn, from the onsets at `beat` on
+static void swap_pattern(Euclidean *self, unsigned short gen, double beat) {
+    apply_pending_pattern(self, gen);
+    self->dirty &= ~(1ULL << gen);
+    self->telemetry.recalculations++;
+    if (playable(self, gen)) {
+        find_onset_from(self, gen, beat);
+    }
+}
+
+// SplitMix64: consecutive seeds give unrelated numbers
+static inline uint64_t splitmix64(uint64_t *x) {
+    uint64_t z = (*x += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Draw the onsets that the probability lane of a generator leaves out of its current repetition. Each step gets a
+// random number from 0 to 3, as two planes of random bits, and is left out when the number is below the value of the
+// step in the lane: a whole word of steps at a time. The draw only depends on the generator and the repetition, so a
+// repetition played again (in a loop, say) plays the same onsets.
+static void draw_repetition(Euclidean *self, unsigned short gen) {
+    const Lanes *lanes = &self->state.lanes[gen];
+    uint64_t x = (uint64_t) self->state.repetition[gen] << 8 | gen;
+
+    for (unsigned short j = 0; j < PATTERN_WORDS; ++j) {
+        const uint64_t b0 = lanes->probability[0].w[j], b1 = lanes->probability[1].w[j];
+        const uint64_t r0 = splitmix64(&x), r1 = splitmix64(&x);
+        self->state.dropped[gen].w[j] = (b1 & ~r1) | (b0 & ~r0 & ~(b1 ^ r1));
+    }
+    self->state.drawn_repetition[gen] = self->state.repetition[gen];
+}
+
+// Work out when the next note on of a generator is. When its pattern has no onsets left, the pattern starts over, or
+// the one waiting for it takes over.
+static void schedule_next_on(Euclidean *self, unsigned short gen) {
+    if (!playable(self, gen)) {
+        self->state.next_on[gen] = LONG_MAX;
+        return;
+    }
+
+    if (self->state.active[gen].entry->steps[self->state.note_on_index[gen]] == NO_ONSET) {
+        self->state.repetition[gen]++;
+        self->state.note_on_index[gen] = 0;
+    }
+    if (frame_at(self, onset_beat(self, gen)) < self->common_state.frame) {
+        // whole repetitions have gone by
+        find_onset(self, gen);
+    }
+
+    if ((self->state.swapping >> gen & 1) && step_beat(self, gen) >= self->state.swap_beat[gen]) {
+        swap_pattern(self, gen, self->state.swap_beat[gen]);
+        if (!playable(self, gen)) {
+            self->state.next_on[gen] = LONG_MAX;
+            return;
+        }
+        if (frame_at(self, onset_beat(self, gen)) < self->common_state.frame) {
+            find_onset(self, gen);
+        }
+    }
+
+    if (self->state.drawn_repetition[gen] != self->state.repetition[gen]) {
+        draw_repetition(self, gen);
+    }
+    self->state.next_on_beat[gen] = onset_beat(self, gen);
+    self->state.next_on[gen] = frame_at(self, self->state.next_on_beat[gen]);
+}
+
+// Point a generator to the first of its onsets that hasn't been played yet. Starting over from somewhere else, a
+// layout waiting for its turn takes over right away.
+static void locate(Euclidean *self, unsigned short gen) {
+    if (self->state.swapping >> gen & 1) {
+        swap_pattern(self, gen, beat_at(self, self->common_state.frame));
+    }
+    if (playable(self, gen)) {
+        find_onset(self, gen);
+    }
+    schedule_next_on(self, gen);
+}
+
+// Place again in time the next onset of every generator, after the tempo or the musical time changed
+static void retime(Euclidean *self) {
     for (unsigned short gen = 0; gen < N_GENERATORS; ++gen) {
-        const unsigned short size_in_bars = self->state[gen].size_in_bars;
-        const unsigned short beats = self->state[gen].beats;
-        const long reference_frame = self->state[gen].reference_frame;
-        unsigned long et = self->state[gen].euclidean;
-        long *note_on = self->state[gen].note_on_vector;
-        long *note_off = self->state[gen].note_off_vector;
-
-        // How many frames per pattern?
-        const long frames_per_pattern = frames_per_bar * size_in_bars;
-
-        const long delta = frames_per_pattern / beats;
-
-        long f = reference_frame;
-        const unsigned long mask = 1L << (beats - 1);
-        for (int i = 0, j = 0; i < beats; ++i) {
-            if ((et & mask) != 0L) {
-                note_on[j] = f;
-                note_off[j] = f + frames_per_tick;
-                ++j;
-            }
-            et <<= 1;
-            f += delta;
+        if (self->state.next_on[gen] != LONG_MAX) {
+            self->state.next_on[gen] = frame_at(self, self->state.next_on_beat[gen]);
         }
     }
 }
 
+// The onsets themselves come listed with the pattern, so all that is left is to find where the generator is in them
+static void recalculate_generator(Euclidean *self, unsigned short gen) {
+    self->dirty &= ~(1ULL << gen);
+    self->telemetry.recalculations++;
+    locate(self, gen);
+}
+
+// List again the onsets of the generators marked as dirty. Disabled generators stay dirty until they are enabled.
+static void recalculate_onsets(Euclidean *self) {
+    uint64_t dirty = self->dirty & self->state.enabled;
+    while (dirty != 0) {
+        const unsigned short gen = (unsigned short) __builtin_ctzll(dirty);
+        dirty &= dirty - 1;
+        recalculate_generator(self, gen);
+    }
+}
+
+// Borrow a pattern from the cache, copying it from the database rather than computing it if the cache doesn't have it
+static const Pattern_entry *acquire_pattern(const Euclidean *self, unsigned short onsets, unsigned short beats,
+                                            short rotation) {
+    pattern known;
+    const bool found = pattern_db_find(&self->database, onsets, beats, rotation, &known);
+    return pattern_cache_acquire(onsets, beats, rotation, found ? &known : NULL);
+}
+
 static LV2_Handle instantiate(const LV2_Descriptor *descriptor,
                               double rate,
                               const char *path,
@@ -180,10 +676,12 @@ static LV2_Handle instantiate(const LV2_Descriptor *descriptor,
 
     self->logger.log = NULL;
     self->map = NULL;
+    self->schedule = NULL;
     // clang-format off
     const char *missing = lv2_features_query(features,
                                              LV2_LOG__log, &self->logger.log, false,
                                              LV2_URID__map, &self->map, true,
+                                             LV2_WORKER__schedule, &self->schedule, false,
                                              NULL);
     // clang-format on
 
@@ -195,233 +693,1421 @@ static LV2_Handle instantiate(const LV2_Descriptor *descriptor,
         return NULL;
     }
 
+    self->own_memory = calloc(2 * N_GENERATORS, PATTERN_ENTRY_SIZE);
+    if (!self->own_memory) {
+        free(self);
+        return NULL;
+    }
+    for (unsigned short gen = 0; gen < N_GENERATORS; ++gen) {
+        for (unsigned i = 0; i < 2; ++i) {
+            self->own_entries[gen][i] = (Pattern_entry *) ((char *) self->own_memory + (2 * gen + i) * PATTERN_ENTRY_SIZE);
+        }
+    }
+
     map_uris(self->map, &self->uris);
+    lv2_atom_forge_init(&self->forge, self->map);
+    if (!pattern_db_open(&self->database, path)) {
+        lv2_log_trace(&self->logger, "No usable %s in %s, patterns will be computed\n", PATTERN_DB_FILE, path);
+    }
 
     // Initialise instance fields
     self->common_state.current_bar = -1;
+    self->common_state.frame = -1;
     self->common_state.frames_per_second = (float) rate;
+    self->state.enabled = 1;
+    self->state.has_pending = 0;
     for (unsigned short gen = 0; gen < N_GENERATORS; ++gen) {
-        self->state[gen].enabled = gen == 0;
-        self->state[gen].note_on_vector = NULL;
-        self->state[gen].note_off_vector = NULL;
-        self->state[gen].beats = 8;
-        self->state[gen].onsets = 0;
-        self->state[gen].rotation = 0;
-        self->state[gen].size_in_bars = 1;
-        self->state[gen].reference_frame = 0;
-        self->state[gen].euclidean = 0;
-        self->state[gen].playing = 0;
+        self->state.next_on[gen] = LONG_MAX;
+        self->state.beats[gen] = 8;
+        self->state.onsets[gen] = 0;
+        self->state.rotation[gen] = 0;
+        self->state.size_in_bars[gen] = 1;
+        self->state.repetition[gen] = 0;
+        self->state.active[gen].entry = acquire_pattern(self, 0, 8, 0);
+        self->state.active[gen].size_in_bars = 1;
+        self->state.serial[gen] = 0;
+        for (unsigned parameter = 0; parameter < N_PROPERTIES; ++parameter) {
+            self->ports.seen[parameter][gen] = NAN;
+        }
     }
+    pattern_cache_collect();
     return (LV2_Handle) self;
 }
 
+// Nothing is sounding any more
+static void forget_sounding(Euclidean *self) {
+    self->sounding.count = 0;
+    memset(self->sounding.position, 0, sizeof(self->sounding.position));
+}
+
+static inline void place_note_off(Euclidean *self, uint16_t i, const Note_off *off) {
+    self->sounding.heap[i] = *off;
+    self->sounding.position[off->channel][off->note] = (uint16_t) (i + 1);
+}
+
+// Move the note off in slot `i` up or down the heap, to where its frame belongs
+static void sift_note_off(Euclidean *self, uint16_t i) {
+    const Note_off off = self->sounding.heap[i];
+    while (i > 0 && self->sounding.heap[(i - 1) / 2].frame > off.frame) {
+        place_note_off(self, i, &self->sounding.heap[(i - 1) / 2]);
+        i = (uint16_t) ((i - 1) / 2);
+    }
+    for (;;) {
+        uint16_t child = (uint16_t) (2 * i + 1);
+        if (child >= self->sounding.count) {
+            break;
+        }
+        if (child + 1 < self->sounding.count &&
+            self->sounding.heap[child + 1].frame < self->sounding.heap[child].frame) {
+            child++;
+        }
+        if (self->sounding.heap[child].frame >= off.frame) {
+            break;
+        }
+        place_note_off(self, i, &self->sounding.heap[child]);
+        i = child;
+    }
+    place_note_off(self, i, &off);
+}
+
+// A note starts sounding, until `frame`. There must be room for it.
+static void push_note_off(Euclidean *self, long frame, uint8_t channel, uint8_t note) {
+    const Note_off off = {frame, channel, note};
+    place_note_off(self, self->sounding.count++, &off);
+    sift_note_off(self, (uint16_t) (self->sounding.count - 1));
+}
+
+// A note stops sounding; `i` is its slot in the heap
+static Note_off remove_note_off(Euclidean *self, uint16_t i) {
+    const Note_off off = self->sounding.heap[i];
+    self->sounding.position[off.channel][off.note] = 0;
+    if (i != --self->sounding.count) {
+        place_note_off(self, i, &self->sounding.heap[self->sounding.count]);
+        sift_note_off(self, i);
+    }
+    return off;
+}
+
+static void activate(LV2_Handle instance) {
+    Euclidean *self = (Euclidean *) instance;
+
+    // Nothing is playing yet, and nothing is known about the transport until the host tells us
+    self->common_state.speed = 0;
+    self->common_state.current_bar = -1;
+    self->common_state.frame = -1;
+    self->common_state.anchor_frame = 0;
+    self->common_state.anchor_beat = 0;
+    self->common_state.internal_clock = false;
+    forget_sounding(self);
+    self->dirty = ALL_GENERATORS;
+    recalculate_onsets(self);
+}
+
+// Format what the audio thread logged, and hand it over to the host. This happens in the worker, or when the plugin
+// is deactivated if the host offers no worker: never in run().
+static void flush_log(Euclidean *self) {
+    RT_log_record record;
+    char text[128];
+
+    while (rt_log_pop(&self->log, &record)) {
+        const Log_message *message = &log_messages[record.code];
+        const int generator = (int) record.generator;
+        const int value = (int) record.value;
+        switch (message->arguments) {
+            case LOG_ARGS_VALUE:
+                snprintf(text, sizeof(text), message->format, value);
+                break;
+            case LOG_ARGS_GENERATOR:
+                snprintf(text, sizeof(text), message->format, generator);
+                break;
+            case LOG_ARGS_GENERATOR_VALUE:
+                snprintf(text, sizeof(text), message->format, generator, value);
+                break;
+            case LOG_ARGS_REAL:
+                snprintf(text, sizeof(text), message->format, (double) record.value / 1000.0);
+                break;
+        }
+        if (message->error) {
+            lv2_log_error(&self->logger, "%s", text);
+        } else {
+            lv2_log_trace(&self->logger, "%s", text);
+        }
+    }
+
+    const uint32_t dropped = rt_log_take_dropped(&self->log);
+    if (dropped > 0) {
+        lv2_log_warning(&self->logger, "%u log messages were lost\n", dropped);
+    }
+}
+
+static void deactivate(LV2_Handle instance) {
+    Euclidean *self = (Euclidean *) instance;
+
+    // Whatever was playing has been cut off by the host, and the transport will have moved on when we're back
+    self->common_state.speed = 0;
+    self->common_state.frame = -1;
+    forget_sounding(self);
+
+    // Without a worker nobody else empties the log, and we're out of the audio thread now. (With one, only the worker
+    // empties it, cleanup() aside.)
+    if (self->schedule == NULL) {
+        flush_log(self);
+    }
+}
+
 static void cleanup(LV2_Handle instance) {
     Euclidean *self = (Euclidean *) instance;
+    flush_log(self);
     for (unsigned short gen = 0; gen < N_GENERATORS; ++gen) {
-        if (self->state[gen].note_on_vector != NULL) {
-            free(self->state[gen].note_on_vector);
-            self->state[gen].note_on_vector = NULL;
+        pattern_cache_release(self->state.active[gen].entry);
+        if (self->state.has_pending >> gen & 1) {
+            pattern_cache_release(self->state.pending[gen].entry);
         }
-        if (self->state[gen].note_off_vector != NULL) {
-            free(self->state[gen].note_off_vector);
-            self->state[gen].note_off_vector = NULL;
+        pattern_cache_release(self->restored_entries[gen]);
+    }
+    pattern_db_close(&self->database);
+    free(self->own_memory);
+    free(self);
+    pattern_cache_collect();
+}
+
+// One bit per generator whose frame in `frames` comes before `limit`. The frames are compared two or four at a time:
+// `frames[g] - limit` can't overflow (frames are never far below zero, and limit isn't negative), so its sign bit
+// is the outcome of the comparison.
+static uint64_t due_mask(const long *frames, long limit) {
+    uint64_t mask = 0;
+    unsigned short g = 0;
+#if defined(__AVX2__) && LONG_MAX == INT64_MAX
+    const __m256i limits = _mm256_set1_epi64x(limit);
+    for (; g + 4 <= N_GENERATORS; g += 4) {
+        const __m256i d = _mm256_sub_epi64(_mm256_loadu_si256((const __m256i *) (frames + g)), limits);
+        mask |= (uint64_t) _mm256_movemask_pd(_mm256_castsi256_pd(d)) << g;
+    }
+#elif defined(__SSE2__) && LONG_MAX == INT64_MAX
+    const __m128i limits = _mm_set1_epi64x(limit);
+    for (; g + 2 <= N_GENERATORS; g += 2) {
+        const __m128i d = _mm_sub_epi64(_mm_loadu_si128((const __m128i *) (frames + g)), limits);
+        mask |= (uint64_t) _mm_movemask_pd(_mm_castsi128_pd(d)) << g;
+    }
+#endif
+    for (; g < N_GENERATORS; ++g) {
+        mask |= (uint64_t) (frames[g] < limit) << g;
+    }
+    return mask;
+}
+
+// Append the notes of a batch to the output, as many as fit in it, with a single copy
+static void write_notes(Euclidean *self, Note_batch *batch) {
+    LV2_Atom_Sequence *out = self->ports.midi_out;
+    const uint32_t room =
+            batch->capacity > out->atom.size ? (batch->capacity - out->atom.size) / (uint32_t) sizeof(MIDI_note_event) : 0;
+    const uint32_t count = batch->count < room ? batch->count : room;
+
+    memcpy(lv2_atom_sequence_end(&out->body, out->atom.size), batch->notes, count * sizeof(MIDI_note_event));
+    out->atom.size += count * (uint32_t) sizeof(MIDI_note_event);
+    self->telemetry.events += count;
+    self->telemetry.dropped_events += batch->count - count;
+    batch->count = 0;
+}
+
+// Room for one more note in the batch, making it if the batch is full
+static inline MIDI_note_event *next_note(Euclidean *self, Note_batch *batch) {
+    if (batch->count == BATCH_CAPACITY) {
+        write_notes(self, batch);
+    }
+    return &batch->notes[batch->count++];
+}
+
+static inline void add_note(Euclidean *self, Note_batch *batch, int64_t offset, uint8_t status, uint8_t key,
+                            uint8_t velocity) {
+    MIDI_note_event *note = next_note(self, batch);
+    note->event.time.frames = offset;
+    note->event.body.type = self->uris.midi_Event;
+    note->event.body.size = 3;
+    note->msg[0] = status;
+    note->msg[1] = key;
+    note->msg[2] = velocity;
+}
+
+// How long (in frames) the notes of a generator last: the share of a step that its gate says, and never less than a
+// MIDI tick (which is also what a gate of 0 means)
+static long gate_frames(const Euclidean *self, unsigned short gen, long frames_per_tick) {
+    const double step_beats = self->state.active[gen].size_in_bars * (double) self->common_state.beats_per_bar /
+                              self->state.active[gen].entry->beats;
+    const long frames = (long) (self->state.gate[gen] / 100.0 * step_beats * self->common_state.frames_per_beat);
+    return frames > frames_per_tick ? frames : frames_per_tick;
+}
+
+// A velocity made from `velocity`, kept in range. However loud or soft it's made, a note played stays a note played (a
+// velocity of 0 would switch it off), and one set to 0 stays silent.
+static inline uint8_t clamp_velocity(uint8_t velocity, int value) {
+    return velocity == 0 ? 0 : (uint8_t) (value < 1 ? 1 : value > 127 ? 127 : value);
+}
+
+// Velocity of a step of a generator, as its level and accent lanes have it: each level a quarter softer, and accents
+// louder by ACCENT_VELOCITY
+static inline uint8_t lane_velocity(const Euclidean *self, unsigned short gen, unsigned short step) {
+    const Lanes *lanes = &self->state.lanes[gen];
+    const uint8_t velocity = self->state.velocity[gen];
+    const int level = pattern_test(&lanes->level[0], step) | pattern_test(&lanes->level[1], step) << 1;
+    return clamp_velocity(velocity,
+                          velocity * (4 - level) / 4 + (pattern_test(&lanes->accent, step) ? ACCENT_VELOCITY : 0));
+}
+
+// Velocity of a note once humanized, moved by the offset drawn for its step
+static inline uint8_t groove_velocity(uint8_t velocity, int8_t offset) {
+    return clamp_velocity(velocity, velocity + offset);
+}
+
+// Add to the batch, in time order and at their exact offsets, all the notes due in the part [begin, end) of the block,
+// leaving the transport at the frame corresponding to `end`. Each generator's notes come in time order, and so do
+// the note offs off the top of the heap, so picking the earliest of those due, time after time, merges them.
+static void render(Euclidean *self, Note_batch *batch, uint32_t begin, uint32_t end) {
+    const long first = self->common_state.frame;
+    if (self->common_state.speed <= 0 || first < 0) {
+        // A transport standing still lets go of every note still sounding, right away, however long its gate
+        while (self->sounding.count > 0) {
+            const Note_off off = remove_note_off(self, (uint16_t) (self->sounding.count - 1));
+            add_note(self, batch, begin, LV2_MIDI_MSG_NOTE_OFF + off.channel, off.note, 0x00);
         }
+        return;
     }
-    free(instance);
+    const long last = first + (long) (end - begin);
+
+    // Most of the time nothing at all happens in a stretch
+    uint64_t due_on = due_mask(self->state.next_on, last);
+
+    // How many frames per MIDI tick (minimum sensible length of a note)?
+    const float fps = self->common_state.frames_per_second;
+    const float bpm = self->common_state.beats_per_minute;
+    const long frames_per_tick = bpm > 0 ? (long) ((60 * fps) / (bpm * 24)) : 0;
+
+    for (;;) {
+        long frame = LONG_MAX;
+        unsigned short gen = 0;
+        for (uint64_t m = due_on; m != 0; m &= m - 1) {
+            const unsigned short g = (unsigned short) __builtin_ctzll(m);
+            if (self->state.next_on[g] < frame) {
+                frame = self->state.next_on[g];
+                gen = g;
+            }
+        }
+
+        // Note offs go first, so that a note ending where the next one starts can be played again
+        if (self->sounding.count > 0 && self->sounding.heap[0].frame < last && self->sounding.heap[0].frame <= frame) {
+            const Note_off off = remove_note_off(self, 0);
+            add_note(self, batch, begin + (off.frame > first ? off.frame - first : 0),
+                     LV2_MIDI_MSG_NOTE_OFF + off.channel, off.note, 0x00);
+            continue;
+        }
+        if (due_on == 0) {
+            break;
+        }
+
+        const uint64_t bit = 1ULL << gen;
+        const int64_t offset = begin + (frame > first ? frame - first : 0);
+        const uint8_t channel = self->state.channel[gen] & 0x0F;
+        const uint8_t key = self->state.note[gen] & 0x7F;
+        const unsigned short step = self->state.active[gen].entry->steps[self->state.note_on_index[gen]];
+
+        // (unless the probability lane left the onset out of this repetition)
+        if (!pattern_test(&self->state.dropped[gen], step)) {
+            // A note can't sound twice at once: if it is still sounding (a gate longer than the distance between
+            // onsets, or another generator playing it), it is switched off to be played again
+            const uint16_t position = self->sounding.position[channel][key];
+            if (position != 0) {
+                remove_note_off(self, (uint16_t) (position - 1));
+                add_note(self, batch, offset, LV2_MIDI_MSG_NOTE_OFF + channel, key, 0x00);
+            }
+            if (self->sounding.count < NOTE_OFF_CAPACITY) {
+                add_note(self, batch, offset, LV2_MIDI_MSG_NOTE_ON + channel, key,
+                         groove_velocity(lane_velocity(self, gen, step), self->state.velocity_offset[gen][step]));
+                push_note_off(self, frame + gate_frames(self, gen, frames_per_tick), channel, key);
+                self->telemetry.late_onsets += frame < first;
+            } else {
+                self->telemetry.missed_onsets++;
+            }
+        }
+        self->state.note_on_index[gen]++;
+        schedule_next_on(self, gen);
+        if (self->state.next_on[gen] >= last) due_on &= ~bit;
+    }
+
+    self->common_state.frame = last;
 }
 
-static void run(LV2_Handle instance, uint32_t sample_count) {
-    Euclidean *self = (Euclidean *) instance;
-    Euclidean_URIs *uris = &self->uris;
+// Change the tempo from the frame the transport is at. True if it changed.
+static bool set_tempo(Euclidean *self, float beats_per_minute) {
+    if (self->common_state.beats_per_minute == beats_per_minute) {
+        return false;
+    }
+    // the music played so far stays where it was, only what comes from now on goes faster or slower
+    const long frame = self->common_state.frame;
+    if (self->common_state.frames_per_beat > 0 && frame >= 0) {
+        self->common_state.anchor_beat = beat_at(self, frame);
+        self->common_state.anchor_frame = frame;
+    }
+    self->common_state.beats_per_minute = beats_per_minute;
+    self->common_state.frames_per_beat =
+            beats_per_minute > 0 ? 60.0 * self->common_state.frames_per_second / beats_per_minute : 0;
 
-    typedef struct {
-        LV2_Atom_Event event;
-        uint8_t msg[3];
-    } MIDI_note_event;
+    trace(self, LOG_TEMPO, 0, lround(beats_per_minute * 1000.0));
+    return true;
+}
 
-    const uint32_t out_capacity = self->ports.midi_out->atom.size;
+// What a time:Position from the host says about the transport, found in it once (NULL where it says nothing)
+typedef struct {
+    const LV2_Atom *beats_per_minute;
+    const LV2_Atom *beats_per_bar;
+    const LV2_Atom *bar;
+    const LV2_Atom *bar_beat;
+    const LV2_Atom *frame;
+    const LV2_Atom *speed;
+} Host_position;
 
-    // Write an empty Sequence header to the output
-    lv2_atom_sequence_clear(self->ports.midi_out);
-    self->ports.midi_out->atom.type = uris->atom_Sequence;
+static void read_position(const Euclidean *self, const LV2_Atom_Object *obj, Host_position *position) {
+    const Euclidean_URIs *uris = &self->uris;
+    memset(position, 0, sizeof(Host_position));
+    // clang-format off
+    lv2_atom_object_get(obj,
+                        uris->time_beats_per_minute, &position->beats_per_minute,
+                        uris->time_beats_per_bar, &position->beats_per_bar,
+                        uris->time_bar, &position->bar,
+                        uris->time_bar_beat, &position->bar_beat,
+                        uris->time_frame, &position->frame,
+                        uris->time_speed, &position->speed,
+                        NULL);
+    // clang-format on
+}
+
+static void update_position(Euclidean *self, const Host_position *position) {
+    // Without a frame from the host, carry on from where the transport was extrapolated to. A frame too far from
+    // there means that the transport jumped (a seek, or a loop), and every generator has to start over.
+    bool jumped = false;
+    if (position->frame != 0) {
+        const long host_frame = (long) ((LV2_Atom_Long *) position->frame)->body;
+        jumped = self->common_state.frame >= 0 && labs(host_frame - self->common_state.frame) > RESYNC_TOLERANCE;
+        self->common_state.frame = host_frame;
+    }
+    const long frame = self->common_state.frame;
+
+    // Notes still sounding when the transport jumps are cut off right where it lands (all at the same frame, the
+    // heap is still a heap)
+    if (jumped) {
+        for (uint16_t i = 0; i < self->sounding.count; ++i) {
+            self->sounding.heap[i].frame = frame;
+        }
+    }
+
+    if (position->speed != 0) {
+        const float speed = (float) ((LV2_Atom_Float *) position->speed)->body;
+        self->common_state.speed = speed;
+    }
 
+    // Whether the generators have to look for their next onsets again, or just place them in time again
+    bool relocate = jumped;
+    bool moved = false;
+
+    if (position->beats_per_minute != 0) {
+        moved |= set_tempo(self, (float) ((LV2_Atom_Float *) position->beats_per_minute)->body);
+    }
+
+    if (position->beats_per_bar != 0) {
+        const float beats_per_bar = (float) ((LV2_Atom_Float *) position->beats_per_bar)->body;
+        if (self->common_state.beats_per_bar != beats_per_bar) {
+            self->common_state.beats_per_bar = beats_per_bar;
+
+            trace(self, LOG_BEATS_PER_BAR, 0, lround(beats_per_bar * 1000.0));
+            relocate = true;
+        }
+    }
+
+    if (position->bar != 0 && frame >= 0 && self->common_state.frames_per_beat > 0) {
+        const long current_bar = (long) ((LV2_Atom_Long *) position->bar)->body;
+        const bool bar_changed = current_bar != self->common_state.current_bar;
+        self->common_state.current_bar = current_bar;
+
+        // Find out where in musical time the transport is. Hosts that don't tell us how far into the bar they are
+        // can only be followed when the bar changes, assuming that it changed right now.
+        if (position->bar_beat != 0 || bar_changed) {
+            const float bar_beat = position->bar_beat != 0 ? ((LV2_Atom_Float *) position->bar_beat)->body : 0;
+            const double host_beat = current_bar * (double) self->common_state.beats_per_bar + bar_beat;
+
+            // A host that has drifted from our own reckoning, or that moved elsewhere in the song
+            const double drift = (host_beat - beat_at(self, frame)) * self->common_state.frames_per_beat;
+            if (fabs(drift) > RESYNC_TOLERANCE) {
+                trace(self, LOG_RELOCATE, 0, llround(host_beat * 1000.0));
+                relocate = true;
+            }
+
+            self->common_state.anchor_frame = frame;
+            self->common_state.anchor_beat = host_beat;
+            moved = true;
+        }
+    }
+
+    if (relocate) {
+        // the onsets are still valid, they just start from somewhere else
+        for (unsigned short gen = 0; gen < N_GENERATORS; ++gen) {
+            locate(self, gen);
+        }
+    } else if (moved) {
+        retime(self);
+    }
+
+    if (self->dirty != 0)
+        recalculate_onsets(self);
+}
+
+// Does a position from the host say nothing new? Only what the generators follow counts: the tempo, the meter, the
+// speed, and the bar and beat, against where our own reckoning puts the transport at the frame of the position.
+static bool same_position(const Euclidean *self, const Host_position *position) {
+    if (self->common_state.frame < 0 || self->common_state.frames_per_beat <= 0) {
+        return false;
+    }
+
+    long frame = self->common_state.frame;
+    if (position->frame != 0) {
+        frame = (long) ((LV2_Atom_Long *) position->frame)->body;
+        if (labs(frame - self->common_state.frame) > RESYNC_TOLERANCE) {
+            return false;
+        }
+    }
+    if ((position->beats_per_minute != 0 &&
+         (float) ((LV2_Atom_Float *) position->beats_per_minute)->body != self->common_state.beats_per_minute) ||
+        (position->beats_per_bar != 0 &&
+         (float) ((LV2_Atom_Float *) position->beats_per_bar)->body != self->common_state.beats_per_bar) ||
+        (position->speed != 0 && (float) ((LV2_Atom_Float *) position->speed)->body != self->common_state.speed)) {
+        return false;
+    }
+    if (position->bar != 0) {
+        const long current_bar = (long) ((LV2_Atom_Long *) position->bar)->body;
+        if (current_bar != self->common_state.current_bar) {
+            return false;
+        }
+        if (position->bar_beat != 0) {
+            const double host_beat = current_bar * (double) self->common_state.beats_per_bar +
+                                     ((LV2_Atom_Float *) position->bar_beat)->body;
+            if (fabs(host_beat - beat_at(self, frame)) * self->common_state.frames_per_beat > RESYNC_TOLERANCE) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// The tempo of the internal clock, as its port says
+static float internal_tempo(const Euclidean *self) {
+    if (self->ports.tempo == NULL) {
+        return DEFAULT_TEMPO;
+    }
+    const float tempo = *self->ports.tempo;
+    return !(tempo >= MIN_TEMPO) ? MIN_TEMPO : tempo > MAX_TEMPO ? MAX_TEMPO : tempo;
+}
+
+// Keep time by ourselves, or follow the host again, as the clock port says. Our own transport goes on from where the
+// host's was (or from the start, if the host never said), always rolling, and the frame moves on with every block
+// rendered. Back with the host, its positions are followed again from wherever our own transport got to.
+static void update_clock(Euclidean *self) {
+    const bool internal = self->ports.clock != NULL && *self->ports.clock > 0;
+
+    if (internal != self->common_state.internal_clock) {
+        self->common_state.internal_clock = internal;
+        if (!internal) {
+            trace(self, LOG_HOST_CLOCK, 0, 0);
+            return;
+        }
+
+        long frame = self->common_state.frame;
+        if (frame < 0) {
+            frame = self->common_state.frame = 0;
+            self->common_state.anchor_frame = 0;
+            self->common_state.anchor_beat = 0;
+        } else if (self->common_state.frames_per_beat > 0) {
+            self->common_state.anchor_beat = beat_at(self, frame);
+            self->common_state.anchor_frame = frame;
+        }
+        self->common_state.speed = 1;
+        if (self->common_state.beats_per_bar <= 0) {
+            self->common_state.beats_per_bar = DEFAULT_BEATS_PER_BAR;
+        }
+        set_tempo(self, internal_tempo(self));
+        trace(self, LOG_INTERNAL_CLOCK, 0, llround(beat_at(self, frame) * 1000.0));
+
+        for (unsigned short gen = 0; gen < N_GENERATORS; ++gen) {
+            locate(self, gen);
+        }
+        if (self->dirty != 0)
+            recalculate_onsets(self);
+    } else if (internal && set_tempo(self, internal_tempo(self))) {
+        retime(self);
+    }
+}
+
+// The Euclidean pattern of a generator, copied from the database if it is there
+static void euclidean_pattern(const Euclidean *self, unsigned short onsets, unsigned short beats, short rotation,
+                              pattern *p) {
+    if (!pattern_db_find(&self->database, onsets, beats, rotation, p)) {
+        pattern_euclidean(p, onsets, beats, rotation);
+    }
+}
+
+// Combine two patterns a word at a time, keeping the first `beats` beats, and rotate the result
+static void combine_patterns(pattern *p, unsigned combination, const pattern *first, const pattern *second,
+                             unsigned short beats, short rotation) {
+    for (unsigned short j = 0; j < PATTERN_WORDS; ++j) {
+        uint64_t w;
+        switch (combination) {
+            case COMBINE_AND:
+                w = first->w[j] & second->w[j];
+                break;
+            case COMBINE_OR:
+                w = first->w[j] | second->w[j];
+                break;
+            case COMBINE_XOR:
+                w = first->w[j] ^ second->w[j];
+                break;
+            default:
+                w = first->w[j] & ~second->w[j];
+                break;
+        }
+        // the longer of the two patterns is cut short
+        const unsigned start = (unsigned) j * WORD_BEATS;
+        if (beats <= start) {
+            w = 0;
+        } else if (beats - start < WORD_BEATS) {
+            w &= ~0ULL << (WORD_BEATS - (beats - start));
+        }
+        p->w[j] = w;
+    }
+    if (rotation % beats != 0) {
+        pattern_rotate(p, beats, rotation);
+    }
+}
+
+// The pattern that a request asks for
+static void requested_pattern(const Euclidean *self, const Pattern_request *request, pattern *p) {
+    if (request->combination == COMBINE_NONE) {
+        euclidean_pattern(self, request->onsets, request->beats, request->rotation, p);
+        return;
+    }
+    pattern first, second;
+    euclidean_pattern(self, request->sources[0].onsets, request->sources[0].beats, request->sources[0].rotation,
+                      &first);
+    euclidean_pattern(self, request->sources[1].onsets, request->sources[1].beats, request->sources[1].rotation,
+                      &second);
+    combine_patterns(p, request->combination, &first, &second, request->beats, request->rotation);
+}
+
+// Computing a pattern means, most of the time, finding that another generator (or instance) already did
+static void compute_pattern(const Euclidean *self, const Pattern_request *request, Pattern_layout *layout) {
+    if (request->combination == COMBINE_NONE) {
+        layout->entry = acquire_pattern(self, request->onsets, request->beats, request->rotation);
+    } else {
+        pattern combined;
+        requested_pattern(self, request, &combined);
+        layout->entry = pattern_cache_acquire_pattern(&combined, request->beats);
+    }
+    layout->size_in_bars = request->size_in_bars;
+}
+
+// ...but the audio thread, computing it when there is no worker, fills in an entry of the generator's own instead: of
+// its two, the one that isn't being played
+static void compute_pattern_in_place(Euclidean *self, const Pattern_request *request, Pattern_layout *layout) {
+    Pattern_entry *const *own = self->own_entries[request->generator];
+    Pattern_entry *entry = own[0] == self->state.active[request->generator].entry ? own[1] : own[0];
+    pattern p;
+    requested_pattern(self, request, &p);
+    if (request->combination == COMBINE_NONE) {
+        pattern_entry_fill(entry, &p, request->onsets, request->beats, request->rotation, false);
+    } else {
+        pattern_entry_fill(entry, &p, pattern_count(&p), request->beats, 0, true);
+    }
+    layout->entry = entry;
+    layout->size_in_bars = request->size_in_bars;
+}
+
+// Have the pending layout of a generator take over at the start of the next repetition of the pattern being played,
+// or right away if nothing is being played. The caller lists again the onsets of generators left dirty.
+static void queue_pattern(Euclidean *self, unsigned short gen) {
+    if (!playable(self, gen) || self->common_state.frame < 0 || self->common_state.speed <= 0) {
+        apply_pending_pattern(self, gen);
+        return;
+    }
+    if (!(self->state.swapping >> gen & 1)) {
+        const double pattern_beats = self->state.active[gen].size_in_bars * (double) self->common_state.beats_per_bar;
+        self->state.swap_beat[gen] = ceil(beat_at(self, self->common_state.frame) / pattern_beats) * pattern_beats;
+        self->state.swapping |= 1ULL << gen;
+    }
+    schedule_next_on(self, gen);
+}
+
+// Would a new pattern of a generator take over right now, before the worker could answer? So it would for a generator
+// without a pattern of its own yet (only the empty one it was instantiated with), whose first onsets may be due in
+// this very block, and for one playing at the very start of a repetition.
+static bool needed_now(const Euclidean *self, unsigned short gen) {
+    if (self->state.active_serial[gen] == 0) {
+        return true;
+    }
+    if (!playable(self, gen) || self->common_state.frame < 0 || self->common_state.speed <= 0) {
+        return false;
+    }
+    const double beat = beat_at(self, self->common_state.frame);
+    if (self->state.swapping >> gen & 1) {
+        return self->state.swap_beat[gen] <= beat;
+    }
+    const double pattern_beats = self->state.active[gen].size_in_bars * (double) self->common_state.beats_per_bar;
+    return ceil(beat / pattern_beats) * pattern_beats <= beat;
+}
+
+// Have the pattern of a generator recomputed off the audio thread, or right now if the host offers no worker or it
+// is needed now
+static void request_pattern(Euclidean *self, unsigned short gen) {
+    const unsigned short first = self->state.first[gen], second = self->state.second[gen];
+    const Pattern_request request = {
+            gen,
+            ++self->state.serial[gen],
+            self->state.onsets[gen],
+            self->state.beats[gen],
+            self->state.rotation[gen],
+            self->state.size_in_bars[gen],
+            self->state.combination[gen],
+            {
+                    {self->state.onsets[first], self->state.beats[first], self->state.rotation[first]},
+                    {self->state.onsets[second], self->state.beats[second], self->state.rotation[second]},
+            },
+    };
+
+    if (self->schedule == NULL || needed_now(self, gen) ||
+        self->schedule->schedule_work(self->schedule->handle, sizeof(request), &request) != LV2_WORKER_SUCCESS) {
+        if (self->state.has_pending >> gen & 1) {
+            pattern_cache_release(self->state.pending[gen].entry);
+        }
+        compute_pattern_in_place(self, &request, &self->state.pending[gen]);
+        self->state.pending_serial[gen] = request.serial;
+        self->state.has_pending |= 1ULL << gen;
+        queue_pattern(self, gen);
+        recalculate_onsets(self);
+    }
+}
+
+static inline void begin_change(Euclidean *self) {
+    __atomic_store_n(&self->changes, self->changes + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void end_change(Euclidean *self) {
+    __atomic_store_n(&self->changes, self->changes + 1, __ATOMIC_RELEASE);
+}
+
+// How many times save() tries to copy the generators before giving up, letting other threads run in between
+#define SNAPSHOT_ATTEMPTS 100000
+
+static inline void yield_thread(void) {
+#if !defined(_WIN32)
+    sched_yield();
+#endif
+}
+
+// What each parameter of a generator may be set to, as its port says
+static const struct {
+    float minimum;
+    float maximum;
+} parameter_ranges[N_PROPERTIES] = {
+        [ENABLED_IDX] = {0, 1},
+        [BEATS_IDX] = {2, MAX_BEATS},
+        [ONSETS_IDX] = {0, MAX_BEATS},
+        [ROTATION_IDX] = {-256, 255},
+        [BARS_IDX] = {1, 8},
+        [CHANNEL_IDX] = {1, 16},
+        [NOTE_IDX] = {0, 127},
+        [VELOCITY_IDX] = {0, 127},
+        [GATE_IDX] = {0, MAX_GATE},
+        [SWING_IDX] = {0, MAX_SWING},
+        [TIMING_IDX] = {0, MAX_TIMING},
+        [DYNAMICS_IDX] = {0, MAX_DYNAMICS},
+        [COMBINATION_IDX] = {0, N_COMBINATIONS - 1},
+        [FIRST_IDX] = {0, N_GENERATORS - 1},
+        [SECOND_IDX] = {0, N_GENERATORS - 1},
+};
+
+// Is a value one that the port of a parameter may take?
+static inline bool in_range(unsigned parameter, float value) {
+    return value >= parameter_ranges[parameter].minimum && value <= parameter_ranges[parameter].maximum;
+}
+
+// xorshift32: the same seed gives the same numbers, on every machine
+static inline uint32_t xorshift32(uint32_t *x) {
+    *x ^= *x << 13;
+    *x ^= *x >> 17;
+    *x ^= *x << 5;
+    return *x;
+}
+
+// A number between -1 and 1
+static inline float jitter(uint32_t *x) {
+    return (float) (xorshift32(x) >> 8) / (1 << 23) - 1.0f;
+}
+
+// Work out, once for every step of the grid, what the groove of a generator does to it: every other step is delayed
+// by the swing, and every step is moved, and played louder or softer, by a little. Each generator has its own seed,
+// so the same settings always humanize it the same way.
+static void build_groove(Euclidean *self, unsigned short gen) {
+    const float swing = self->state.swing[gen] / 100.0f;
+    const float timing = self->state.timing[gen] / 100.0f;
+    const float dynamics = self->state.dynamics[gen];
+    uint32_t x = (gen + 1u) * 0x9E3779B9u;
+
+    for (unsigned short step = 0; step < MAX_BEATS; ++step) {
+        self->state.step_offset[gen][step] = (step & 1 ? swing : 0) + timing * jitter(&x);
+        self->state.velocity_offset[gen][step] = (int8_t) lroundf(dynamics * jitter(&x));
+    }
+}
+
+// Set a parameter of a generator, whether it comes from its port or from a patch message. True if the pattern has to
+// be computed again.
+static bool set_parameter(Euclidean *self, unsigned short gen, unsigned parameter, float value) {
+    // (written so that NaN ends up at the minimum)
+    if (!(value >= parameter_ranges[parameter].minimum)) value = parameter_ranges[parameter].minimum;
+    if (value > parameter_ranges[parameter].maximum) value = parameter_ranges[parameter].maximum;
+
+    switch (parameter) {
+        case ENABLED_IDX: {
+            const bool enabled = value != 0;
+            if (enabled == ((self->state.enabled >> gen) & 1)) {
+                return false;
+            }
+            trace(self, enabled ? LOG_ENABLED : LOG_DISABLED, gen, 0);
+            self->state.enabled ^= 1ULL << gen;
+            locate(self, gen);
+            return enabled;
+        }
+        case BEATS_IDX:
+            if ((unsigned short) value == self->state.beats[gen]) {
+                return false;
+            }
+            trace(self, LOG_BEATS, gen, (unsigned short) value);
+            self->state.beats[gen] = (unsigned short) value;
+            return true;
+        case ONSETS_IDX:
+            if ((unsigned short) value == self->state.onsets[gen]) {
+                return false;
+            }
+            trace(self, LOG_ONSETS, gen, (unsigned short) value);
+            self->state.onsets[gen] = (unsigned short) value;
+            return true;
+        case ROTATION_IDX:
+            if ((short) value == self->state.rotation[gen]) {
+                return false;
+            }
+            trace(self, LOG_ROTATION, gen, (short) value);
+            self->state.rotation[gen] = (short) value;
+            return true;
+        case BARS_IDX:
+            if ((unsigned short) value == self->state.size_in_bars[gen]) {
+                return false;
+            }
+            trace(self, LOG_BARS, gen, (unsigned short) value);
+            self->state.size_in_bars[gen] = (unsigned short) value;
+            return true;
+        case COMBINATION_IDX:
+        case FIRST_IDX:
+        case SECOND_IDX: {
+            uint8_t *combination = parameter == COMBINATION_IDX ? self->state.combination :
+                                   parameter == FIRST_IDX ? self->state.first : self->state.second;
+            if ((uint8_t) value == combination[gen]) {
+                return false;
+            }
+            trace(self, parameter == COMBINATION_IDX ? LOG_COMBINATION :
+                        parameter == FIRST_IDX ? LOG_FIRST : LOG_SECOND, gen, (uint8_t) value);
+            combination[gen] = (uint8_t) value;
+            return true;
+        }
+
+        // the rest only matter when notes are played, so they are just taken as they are
+        case CHANNEL_IDX:
+            self->state.channel[gen] = (uint8_t) ((int) value - 1);
+            return false;
+        case NOTE_IDX:
+            self->state.note[gen] = (uint8_t) value;
+            return false;
+        case VELOCITY_IDX:
+            self->state.velocity[gen] = (uint8_t) value;
+            return false;
+        case GATE_IDX:
+            self->state.gate[gen] = (unsigned short) value;
+            return false;
+
+        // the groove only moves the onsets still to come, once its steps have been worked out again
+        default: {
+            uint8_t *groove = parameter == SWING_IDX ? self->state.swing :
+                              parameter == TIMING_IDX ? self->state.timing : self->state.dynamics;
+            if ((uint8_t) value != groove[gen]) {
+                groove[gen] = (uint8_t) value;
+                build_groove(self, gen);
+            }
+            return false;
+        }
+    }
+}
+
+// The generators whose patterns combine that of `gen` with another
+static uint64_t combining(const Euclidean *self, unsigned short gen) {
+    uint64_t generators = 0;
+    for (unsigned short other = 0; other < N_GENERATORS; ++other) {
+        if (self->state.combination[other] != COMBINE_NONE &&
+            (self->state.first[other] == gen || self->state.second[other] == gen)) {
+            generators |= 1ULL << other;
+        }
+    }
+    return generators;
+}
+
+// Have the pattern of a generator computed again once its parameters changed, and the patterns combining it too
+static void update_pattern(Euclidean *self, unsigned short gen) {
+    for (uint64_t affected = 1ULL << gen | combining(self, gen); affected != 0; affected &= affected - 1) {
+        const unsigned short g = (unsigned short) __builtin_ctzll(affected);
+        if ((self->state.enabled >> g) & 1) {
+            request_pattern(self, g);
+        } else {
+            // the pattern will be computed when the generator is enabled, until then it's out of date
+            self->state.serial[g]++;
+        }
+    }
+}
+
+// Look at the control ports, and take the parameters whose ports moved since the last block
+static void read_ports(Euclidean *self) {
     for (unsigned short gen = 0; gen < N_GENERATORS; ++gen) {
-        // Analyse the parameters
         bool calculate_euclidean = false;
-
-        bool port_enabled = (bool) *self->ports.enabled[gen];
-        if (port_enabled != self->state[gen].enabled) {
-            lv2_log_trace(&self->logger, "[gen %d] plugin status set to %s\n", gen,
-                          port_enabled ? "enabled" : "disabled");
-            self->state[gen].enabled = port_enabled;
-            calculate_euclidean = port_enabled;
+        for (unsigned parameter = 0; parameter < N_PROPERTIES; ++parameter) {
+            const float *port = self->ports.parameters[parameter][gen];
+            if (port != NULL && *port != self->ports.seen[parameter][gen]) {
+                self->ports.seen[parameter][gen] = *port;
+                calculate_euclidean |= set_parameter(self, gen, parameter, *port);
+            }
         }
+        if (calculate_euclidean) {
+            update_pattern(self, gen);
+        }
+    }
+}
+
+// The value of a property in a patch message as a number, if it is one
+static bool patch_number(const Euclidean_URIs *uris, const LV2_Atom *atom, float *number) {
+    if (atom == NULL) {
+        return false;
+    } else if (atom->type == uris->atom_Float) {
+        *number = ((const LV2_Atom_Float *) atom)->body;
+    } else if (atom->type == uris->atom_Double) {
+        *number = (float) ((const LV2_Atom_Double *) atom)->body;
+    } else if (atom->type == uris->atom_Int || atom->type == uris->atom_Bool) {
+        *number = (float) ((const LV2_Atom_Int *) atom)->body;
+    } else if (atom->type == uris->atom_Long) {
+        *number = (float) ((const LV2_Atom_Long *) atom)->body;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// The parameter that a property of a patch message sets, N_PROPERTIES if none
+static unsigned patch_parameter(const Euclidean_URIs *uris, LV2_URID property) {
+    unsigned parameter = 0;
+    while (parameter < N_PROPERTIES && uris->parameters[parameter] != property) {
+        ++parameter;
+    }
+    return parameter;
+}
+
+// ...and the lane, N_LANES if none
+static unsigned patch_lane(const Euclidean_URIs *uris, LV2_URID property) {
+    unsigned lane = 0;
+    while (lane < N_LANES && uris->lanes[lane] != property) {
+        ++lane;
+    }
+    return lane;
+}
+
+// Set a lane of a generator from its string, a character per step
+static void set_lane(Euclidean *self, unsigned short gen, unsigned lane, const char *text, uint32_t size) {
+    Lanes *lanes = &self->state.lanes[gen];
+    pattern *planes = lane == ACCENT_LANE ? &lanes->accent : lane == PROBABILITY_LANE ? lanes->probability : lanes->level;
+    const unsigned n_planes = lane == ACCENT_LANE ? 1 : 2;
 
-        unsigned short port_beats = (unsigned short) *self->ports.beats[gen];
-        if (port_beats != self->state[gen].beats) {
-            lv2_log_trace(&self->logger, "[gen %d] plugin beats per bar set to %d\n", gen, port_beats);
-            self->state[gen].beats = port_beats;
-            calculate_euclidean = true;
+    memset(planes, 0, n_planes * sizeof(pattern));
+    for (unsigned short step = 0; step < MAX_BEATS && step < size && text[step] != '\0'; ++step) {
+        const unsigned value = text[step] >= '0' && text[step] <= '3' ? (unsigned) (text[step] - '0')
+                                                                       : text[step] == 'x' || text[step] == 'X';
+        for (unsigned plane = 0; plane < n_planes; ++plane) {
+            if (value >> plane & 1) {
+                pattern_set(&planes[plane], step);
+            }
         }
+    }
+    trace(self, LOG_LANE, gen, lane);
 
-        unsigned short port_onsets = (unsigned short) *self->ports.onsets[gen];
-        if (port_onsets != self->state[gen].onsets) {
-            lv2_log_trace(&self->logger, "[gen %d] plugin onsets set to %d\n", gen, port_onsets);
-            self->state[gen].onsets = port_onsets;
-            calculate_euclidean = true;
+    // onsets already drawn for the repetition being played are drawn again
+    if (lane == PROBABILITY_LANE) {
+        draw_repetition(self, gen);
+    }
+}
+
+// Set a parameter or a lane of a generator from a property of a patch message, if its value is of the right kind. True
+// if the pattern has to be computed again.
+static bool apply_property(Euclidean *self, unsigned short gen, LV2_URID property, const LV2_Atom *value) {
+    const Euclidean_URIs *uris = &self->uris;
+    const unsigned parameter = patch_parameter(uris, property);
+    float number;
+    if (parameter < N_PROPERTIES) {
+        return patch_number(uris, value, &number) && set_parameter(self, gen, parameter, number);
+    }
+    const unsigned lane = patch_lane(uris, property);
+    if (lane < N_LANES && value != NULL && value->type == uris->atom_String) {
+        set_lane(self, gen, lane, (const char *) LV2_ATOM_BODY_CONST(value), value->size);
+    }
+    return false;
+}
+
+// Set the parameters and lanes of a generator that a patch:Set or a patch:Put carries. Properties that are neither, or
+// whose values aren't of the right kind, are ignored.
+static void apply_patch(Euclidean *self, const LV2_Atom_Object *obj) {
+    const Euclidean_URIs *uris = &self->uris;
+
+    const LV2_Atom *generator_atom = NULL;
+    const LV2_Atom *property_atom = NULL;
+    const LV2_Atom *value_atom = NULL;
+    const LV2_Atom *body_atom = NULL;
+    // clang-format off
+    lv2_atom_object_get(obj,
+                        uris->parameter_generator, &generator_atom,
+                        uris->patch_property, &property_atom,
+                        uris->patch_value, &value_atom,
+                        uris->patch_body, &body_atom,
+                        NULL);
+    // clang-format on
+
+    float number = -1;
+    if (!patch_number(uris, generator_atom, &number) || !(number >= 0 && number < N_GENERATORS)) {
+        trace(self, LOG_PATCH_GENERATOR, 0, number >= 0 && number <= USHRT_MAX ? (int64_t) number : -1);
+        return;
+    }
+    const unsigned short gen = (unsigned short) number;
+
+    bool calculate_euclidean = false;
+    if (obj->body.otype == uris->patch_Set) {
+        if (property_atom != NULL && property_atom->type == uris->atom_URID) {
+            calculate_euclidean = apply_property(self, gen, ((const LV2_Atom_URID *) property_atom)->body, value_atom);
+        }
+    } else if (body_atom != NULL && body_atom->type == uris->atom_Object) {
+        LV2_ATOM_OBJECT_FOREACH((const LV2_Atom_Object *) body_atom, property) {
+            calculate_euclidean |= apply_property(self, gen, property->key, &property->value);
         }
+    }
+    if (calculate_euclidean) {
+        update_pattern(self, gen);
+    }
+}
+
+// Take over, all at once, the generators as the host restored them
+static void apply_snapshot(Euclidean *self) {
+    for (unsigned short gen = 0; gen < N_GENERATORS; ++gen) {
+        const Generator_snapshot *snapshot = &self->restored.generators[gen];
+        const uint64_t bit = 1ULL << gen;
 
-        short port_rotation = (short) *self->ports.rotation[gen];
-        if (port_rotation != self->state[gen].rotation) {
-            lv2_log_trace(&self->logger, "[gen %d] plugin rotation set to %d\n", gen, port_rotation);
-            self->state[gen].rotation = port_rotation;
-            calculate_euclidean = true;
+        self->state.enabled = snapshot->enabled ? self->state.enabled | bit : self->state.enabled & ~bit;
+        self->state.beats[gen] = snapshot->beats;
+        self->state.onsets[gen] = snapshot->onsets;
+        self->state.rotation[gen] = snapshot->rotation;
+        self->state.size_in_bars[gen] = snapshot->size_in_bars;
+        self->state.channel[gen] = snapshot->channel;
+        self->state.note[gen] = snapshot->note;
+        self->state.velocity[gen] = snapshot->velocity;
+        self->state.gate[gen] = snapshot->gate;
+        if (snapshot->swing != self->state.swing[gen] || snapshot->timing != self->state.timing[gen] ||
+            snapshot->dynamics != self->state.dynamics[gen]) {
+            self->state.swing[gen] = snapshot->swing;
+            self->state.timing[gen] = snapshot->timing;
+            self->state.dynamics[gen] = snapshot->dynamics;
+            build_groove(self, gen);
+        }
+        self->state.lanes[gen] = snapshot->lanes;
+        draw_repetition(self, gen);
+        self->state.combination[gen] = snapshot->combination;
+        self->state.first[gen] = snapshot->first;
+        self->state.second[gen] = snapshot->second;
+        pattern_cache_release(self->state.active[gen].entry);
+        self->state.active[gen].entry = __atomic_exchange_n(&self->restored_entries[gen], NULL, __ATOMIC_ACQUIRE);
+        self->state.active[gen].size_in_bars = snapshot->size_in_bars;
+        copy_active_pattern(self, gen);
+        if (self->state.has_pending >> gen & 1) {
+            pattern_cache_release(self->state.pending[gen].entry);
         }
 
-        unsigned short size_in_bars = (unsigned short) *self->ports.bars[gen];
-        if (size_in_bars != self->state[gen].size_in_bars) {
-            lv2_log_trace(&self->logger, "[gen %d] size of the pattern (in bars) set to %d\n", gen, size_in_bars);
-            self->state[gen].size_in_bars = size_in_bars;
-            calculate_euclidean = true;
+        // whatever the worker is computing now answers requests made before the restore
+        self->state.active_serial[gen] = ++self->state.serial[gen];
+
+        // The ports, as they are now, were saved along with the rest: only moving them again overrides what patch
+        // messages had set
+        for (unsigned parameter = 0; parameter < N_PROPERTIES; ++parameter) {
+            const float *port = self->ports.parameters[parameter][gen];
+            if (port != NULL) {
+                self->ports.seen[parameter][gen] = *port;
+            }
         }
+    }
+    self->state.has_pending = 0;
+    self->state.swapping = 0;
+    self->dirty = ALL_GENERATORS;
 
-        if (calculate_euclidean && self->state[gen].enabled) {
-            if (self->state[gen].note_on_vector != NULL) free(self->state[gen].note_on_vector);
-            self->state[gen].note_on_vector = calloc(self->state[gen].onsets + 1, sizeof(long));
+    recalculate_onsets(self);
+    for (unsigned short gen = 0; gen < N_GENERATORS; ++gen) {
+        if (!(self->state.enabled >> gen & 1)) {
+            schedule_next_on(self, gen);
+        }
+    }
+    __atomic_store_n(&self->restore_pending, false, __ATOMIC_RELEASE);
+}
 
-            if (self->state[gen].note_off_vector != NULL) free(self->state[gen].note_off_vector);
-            self->state[gen].note_off_vector = calloc(self->state[gen].onsets + 1, sizeof(long));
+// Processor cycles, where there is a cheap way of counting them, 0 elsewhere
+static inline uint64_t cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
 
-            self->state[gen].note_on_vector[self->state[gen].onsets] = INT64_MAX;
-            self->state[gen].note_off_vector[self->state[gen].onsets] = INT64_MAX;
+static inline void forge_counter(LV2_Atom_Forge *forge, LV2_URID key, uint64_t value) {
+    lv2_atom_forge_key(forge, key);
+    lv2_atom_forge_long(forge, (int64_t) value);
+}
 
-            lv2_log_trace(&self->logger, "[gen %d] recalculating euclidean\n", gen);
+// Account for a block, and publish what happened on the notify port (if it is connected) once about a second's worth
+// of frames have gone by
+static void publish_telemetry(Euclidean *self, uint32_t sample_count, uint64_t block_cycles) {
+    Euclidean_URIs *uris = &self->uris;
+    LV2_Atom_Forge *forge = &self->forge;
+    LV2_Atom_Forge_Frame sequence_frame, object_frame;
 
-            self->state[gen].euclidean = e((unsigned short) *self->ports.onsets[gen],
-                                           (unsigned short) *self->ports.beats[gen],
-                                           (short) *self->ports.rotation[gen]);
+    self->telemetry.frames += sample_count;
+    self->telemetry.blocks++;
+    self->telemetry.cycles += block_cycles;
+    if (block_cycles > self->telemetry.worst_cycles) {
+        self->telemetry.worst_cycles = block_cycles;
+    }
+    const bool due = self->telemetry.frames >= self->common_state.frames_per_second;
 
-            recalculate_onsets(self);
+    if (self->ports.notify != NULL) {
+        lv2_atom_forge_set_buffer(forge, (uint8_t *) self->ports.notify, self->ports.notify->atom.size);
+        lv2_atom_forge_sequence_head(forge, &sequence_frame, 0);
+        if (due) {
+            lv2_atom_forge_frame_time(forge, 0);
+            lv2_atom_forge_object(forge, &object_frame, 0, uris->telemetry_Telemetry);
+            forge_counter(forge, uris->telemetry_blocks, self->telemetry.blocks);
+            forge_counter(forge, uris->telemetry_cycles, self->telemetry.cycles);
+            forge_counter(forge, uris->telemetry_worst_cycles, self->telemetry.worst_cycles);
+            forge_counter(forge, uris->telemetry_events, self->telemetry.events);
+            forge_counter(forge, uris->telemetry_dropped_events, self->telemetry.dropped_events);
+            forge_counter(forge, uris->telemetry_recalculations, self->telemetry.recalculations);
+            forge_counter(forge, uris->telemetry_late_onsets, self->telemetry.late_onsets);
+            forge_counter(forge, uris->telemetry_missed_onsets, self->telemetry.missed_onsets);
+            lv2_atom_forge_pop(forge, &object_frame);
         }
+        lv2_atom_forge_pop(forge, &sequence_frame);
     }
+    if (due) {
+        memset(&self->telemetry, 0, sizeof(self->telemetry));
+    }
+}
+
+static void run(LV2_Handle instance, uint32_t sample_count) {
+    const uint64_t start = cycles();
+    Euclidean *self = (Euclidean *) instance;
+    Euclidean_URIs *uris = &self->uris;
+
+    Note_batch batch;
+    batch.capacity = self->ports.midi_out->atom.size;
+    batch.count = 0;
+
+    // Write an empty Sequence header to the output
+    lv2_atom_sequence_clear(self->ports.midi_out);
+    self->ports.midi_out->atom.type = uris->atom_Sequence;
+
+    begin_change(self);
+    if (__atomic_load_n(&self->restore_pending, __ATOMIC_ACQUIRE)) {
+        apply_snapshot(self);
+    }
+
+    read_ports(self);
+    update_clock(self);
 
+    // Render the block in stretches, following the host's transport wherever it tells us something new about it
+    uint32_t position = 0;
     LV2_ATOM_SEQUENCE_FOREACH(self->ports.control, ev) {
+        render(self, &batch, position, (uint32_t) ev->time.frames);
+        position = (uint32_t) ev->time.frames;
+
         if (ev->body.type == uris->atom_Object) {
             const LV2_Atom_Object *obj = (const LV2_Atom_Object *) &ev->body;
 
             if (obj->body.otype == uris->time_Position) {
-                // Position information from the host will be stored here
-                LV2_Atom const *host_beats_per_minute_atom = NULL;
-                LV2_Atom const *host_beats_per_bar_atom = NULL;
-                LV2_Atom const *host_bar_atom = NULL;
-                LV2_Atom const *host_frame_atom = NULL;
-                LV2_Atom const *host_speed_atom = NULL;
-                // clang-format off
-                lv2_atom_object_get(obj,
-                                    uris->time_beats_per_minute, &host_beats_per_minute_atom,
-                                    uris->time_beats_per_bar, &host_beats_per_bar_atom,
-                                    uris->time_bar, &host_bar_atom,
-                                    uris->time_frame, &host_frame_atom,
-                                    uris->time_speed, &host_speed_atom,
-                                    NULL);
-                // clang-format on
-
-                long frame = -1;
-                if (host_frame_atom != 0) {
-                    frame = (long) ((LV2_Atom_Long *) host_frame_atom)->body;
+                if (!self->common_state.internal_clock) {
+                    Host_position host_position;
+                    read_position(self, obj, &host_position);
+                    if (!same_position(self, &host_position)) {
+                        update_position(self, &host_position);
+                    }
                 }
+            } else if (obj->body.otype == uris->patch_Set || obj->body.otype == uris->patch_Put) {
+                apply_patch(self, obj);
+            }
+        }
+    }
+    render(self, &batch, position, sample_count);
+    end_change(self);
+    write_notes(self, &batch);
 
-                if (host_speed_atom != 0) {
-                    const float speed = (float) ((LV2_Atom_Float *) host_speed_atom)->body;
-                    self->common_state.speed = speed;
-                }
+    // Have the log emptied off the audio thread. Without a worker it waits in the ring (what doesn't fit is counted)
+    // until the plugin is deactivated.
+    if (self->schedule != NULL && !self->log_flush_requested && rt_log_pending(&self->log)) {
+        const Log_flush request = {1};
+        self->log_flush_requested =
+                self->schedule->schedule_work(self->schedule->handle, sizeof(request), &request) == LV2_WORKER_SUCCESS;
+    }
 
-                bool dirty_vector = false;
+    publish_telemetry(self, sample_count, cycles() - start);
+}
 
-                if (host_beats_per_minute_atom != 0) {
-                    const float beats_per_minute = (float) ((LV2_Atom_Float *) host_beats_per_minute_atom)->body;
-                    if (self->common_state.beats_per_minute != beats_per_minute) {
-                        self->common_state.beats_per_minute = beats_per_minute;
+static LV2_Worker_Status work(LV2_Handle instance,
+                              LV2_Worker_Respond_Function respond,
+                              LV2_Worker_Respond_Handle handle,
+                              uint32_t size,
+                              const void *data) {
+    Euclidean *self = (Euclidean *) instance;
+    if (size == sizeof(Log_flush)) {
+        flush_log(self);
+        return respond(handle, size, data);
+    }
+    if (size != sizeof(Pattern_request)) {
+        return LV2_WORKER_ERR_UNKNOWN;
+    }
+    const Pattern_request *request = (const Pattern_request *) data;
 
-                        lv2_log_trace(&self->logger, "dirtying the onsets vector because bpm changed to %f\n",
-                                      beats_per_minute);
-                        dirty_vector = true;
-                    }
-                }
+    lv2_log_trace(&self->logger, "[gen %d] recalculating euclidean\n", request->generator);
 
-                if (host_beats_per_bar_atom != 0) {
-                    const float beats_per_bar = (float) ((LV2_Atom_Float *) host_beats_per_bar_atom)->body;
-                    if (self->common_state.beats_per_bar != beats_per_bar) {
-                        self->common_state.beats_per_bar = beats_per_bar;
+    Pattern_response response;
+    response.generator = request->generator;
+    response.serial = request->serial;
+    compute_pattern(self, request, &response.layout);
+    pattern_cache_collect();
 
-                        lv2_log_trace(&self->logger, "dirtying the onsets vector because beats per bar changed to %f\n",
-                                      beats_per_bar);
-                        dirty_vector = true;
-                    }
-                }
+    return respond(handle, sizeof(response), &response);
+}
 
-                if (host_bar_atom != 0) {
-                    const long current_bar = (long) ((LV2_Atom_Long *) host_bar_atom)->body;
-                    if (current_bar != self->common_state.current_bar) {
-                        // The bar has changed for a new pattern to begin
-                        self->common_state.current_bar = current_bar;
-                        for (unsigned short gen = 0; gen < N_GENERATORS; ++gen) {
-                            if (current_bar % self->state[gen].size_in_bars == 0) {
-                                self->state[gen].reference_frame = frame;
-
-                                self->state[gen].note_on_index = 0;
-                                self->state[gen].note_off_index = 0;
-                            }
-                        }
-                        lv2_log_trace(&self->logger,
-                                      "dirtying the onsets vector because the bar has changed to %ld\n",
-                                      current_bar);
-                        dirty_vector = true;
-                    }
-                }
+static LV2_Worker_Status work_response(LV2_Handle instance, uint32_t size, const void *data) {
+    Euclidean *self = (Euclidean *) instance;
+    if (size == sizeof(Log_flush)) {
+        self->log_flush_requested = false;
+        return LV2_WORKER_SUCCESS;
+    }
+    if (size != sizeof(Pattern_response)) {
+        return LV2_WORKER_ERR_UNKNOWN;
+    }
+    const Pattern_response *response = (const Pattern_response *) data;
+    const unsigned short gen = response->generator;
 
-                if (dirty_vector == true)
-                    recalculate_onsets(self);
-
-                for (unsigned short gen = 0; gen < N_GENERATORS; ++gen) {
-                    if (self->state[gen].enabled) {
-                        // Perhaps produce a MIDI event?
-                        if (self->common_state.speed > 0) {
-                            if (frame >= self->state[gen].note_on_vector[self->state[gen].note_on_index]) {
-
-                                if (self->state[gen].playing == 0) {
-                                    MIDI_note_event note;
-                                    note.event.time.frames = ev->time.frames;
-                                    note.event.body.type = uris->midi_Event;
-                                    note.event.body.size = 3;
-                                    note.msg[0] = LV2_MIDI_MSG_NOTE_ON + (int) *self->ports.channel[gen] - 1;
-                                    note.msg[1] = (int) *self->ports.note[gen];
-                                    note.msg[2] = (int) *self->ports.velocity[gen];
-                                    self->state[gen].playing = (int) *self->ports.note[gen];
-                                    lv2_atom_sequence_append_event(self->ports.midi_out, out_capacity, &note.event);
-                                }
-                                self->state[gen].note_on_index++;
-                            }
-                            if (frame >= self->state[gen].note_off_vector[self->state[gen].note_off_index]) {
-                                if (self->state[gen].playing > 0) {
-                                    MIDI_note_event note;
-                                    note.event.time.frames = ev->time.frames;
-                                    note.event.body.type = uris->midi_Event;
-                                    note.event.body.size = 3;
-                                    note.msg[0] = LV2_MIDI_MSG_NOTE_OFF + (int) *self->ports.channel[gen] - 1;
-                                    note.msg[1] = self->state[gen].playing;
-                                    note.msg[2] = 0x00;
-                                    self->state[gen].playing = 0;
-                                    lv2_atom_sequence_append_event(self->ports.midi_out, out_capacity, &note.event);
-                                }
-                                self->state[gen].note_off_index++;
-                            }
-                        }
-                    }
-                }
+    // Answers to requests that have since been superseded are of no use
+    if (gen < N_GENERATORS && response->serial == self->state.serial[gen]) {
+        if (self->state.has_pending >> gen & 1) {
+            pattern_cache_release(self->state.pending[gen].entry);
+        }
+        self->state.pending[gen] = response->layout;
+        self->state.pending_serial[gen] = response->serial;
+        self->state.has_pending |= 1ULL << gen;
+    } else {
+        pattern_cache_release(response->layout.entry);
+    }
+    return LV2_WORKER_SUCCESS;
+}
+
+// Called once all the responses of the cycle have been delivered: new patterns wait for their turn from the next block
+// (those already waiting keep theirs)
+static LV2_Worker_Status end_run(LV2_Handle instance) {
+    Euclidean *self = (Euclidean *) instance;
+    begin_change(self);
+    uint64_t fresh = self->state.has_pending & ~self->state.swapping;
+    while (fresh != 0) {
+        const unsigned short gen = (unsigned short) __builtin_ctzll(fresh);
+        fresh &= fresh - 1;
+        queue_pattern(self, gen);
+    }
+    recalculate_onsets(self);
+    end_change(self);
+    return LV2_WORKER_SUCCESS;
+}
+
+// Copy the generators as the audio thread has them. save() may be called while run() is changing them, in which case
+// it lets the audio thread finish and makes the copy again.
+static bool take_snapshot(Euclidean *self, Snapshot *snapshot) {
+    memset(snapshot, 0, sizeof(Snapshot));
+    snapshot->version = SNAPSHOT_VERSION;
+    snapshot->n_generators = N_GENERATORS;
+
+    for (long attempt = 0; attempt < SNAPSHOT_ATTEMPTS; ++attempt) {
+        if (attempt > 0) {
+            yield_thread();
+        }
+        const uint32_t before = __atomic_load_n(&self->changes, __ATOMIC_ACQUIRE);
+        if (before & 1) {
+            continue;
+        }
+        for (unsigned short gen = 0; gen < N_GENERATORS; ++gen) {
+            Generator_snapshot *generator = &snapshot->generators[gen];
+            generator->beats = self->state.beats[gen];
+            generator->onsets = self->state.onsets[gen];
+            generator->rotation = self->state.rotation[gen];
+            generator->size_in_bars = self->state.size_in_bars[gen];
+            generator->enabled = self->state.enabled >> gen & 1;
+            generator->channel = self->state.channel[gen];
+            generator->note = self->state.note[gen];
+            generator->velocity = self->state.velocity[gen];
+            generator->gate = self->state.gate[gen];
+            generator->swing = self->state.swing[gen];
+            generator->timing = self->state.timing[gen];
+            generator->dynamics = self->state.dynamics[gen];
+            generator->lanes = self->state.lanes[gen];
+            generator->combination = self->state.combination[gen];
+            generator->first = self->state.first[gen];
+            generator->second = self->state.second[gen];
+            generator->has_pattern = self->state.active_serial[gen] == self->state.serial[gen];
+            if (generator->has_pattern) {
+                generator->euclidean = self->state.active_pattern[gen];
+            } else {
+                memset(&generator->euclidean, 0, sizeof(pattern));
             }
         }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&self->changes, __ATOMIC_RELAXED) == before) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static LV2_State_Status save(LV2_Handle instance,
+                             LV2_State_Store_Function store,
+                             LV2_State_Handle handle,
+                             uint32_t flags,
+                             const LV2_Feature *const *features) {
+    Euclidean *self = (Euclidean *) instance;
+    (void) flags, (void) features;
+
+    Snapshot snapshot;
+    if (!take_snapshot(self, &snapshot)) {
+        lv2_log_error(&self->logger, "Could not take a snapshot of the generators\n");
+        return LV2_STATE_ERR_UNKNOWN;
+    }
+    return store(handle, self->uris.state_snapshot, &snapshot, sizeof(snapshot), self->uris.atom_Chunk,
+                 LV2_STATE_IS_POD);
+}
+
+// Take a saved snapshot. False if it isn't one.
+static bool read_snapshot(const Euclidean *self, const void *value, size_t size, uint32_t type, Snapshot *snapshot) {
+    if (type != self->uris.atom_Chunk || size != sizeof(Snapshot)) {
+        return false;
+    }
+    memcpy(snapshot, value, sizeof(Snapshot));
+    return snapshot->version == SNAPSHOT_VERSION && snapshot->n_generators == N_GENERATORS;
+}
+
+// Check the snapshot and compute whatever patterns it lacks, here and not in the audio thread, which will take it
+// over at the start of its next block
+static LV2_State_Status restore(LV2_Handle instance,
+                                LV2_State_Retrieve_Function retrieve,
+                                LV2_State_Handle handle,
+                                uint32_t flags,
+                                const LV2_Feature *const *features) {
+    Euclidean *self = (Euclidean *) instance;
+    (void) flags, (void) features;
+
+    size_t size;
+    uint32_t type, value_flags;
+    const void *value = retrieve(handle, self->uris.state_snapshot, &size, &type, &value_flags);
+    if (value == NULL) {
+        return LV2_STATE_ERR_NO_PROPERTY;
+    }
+    Snapshot snapshot;
+    if (!read_snapshot(self, value, size, type, &snapshot)) {
+        lv2_log_error(&self->logger, "Ignoring a snapshot of a different kind\n");
+        return LV2_STATE_ERR_BAD_TYPE;
+    }
+    for (unsigned short gen = 0; gen < N_GENERATORS; ++gen) {
+        const Generator_snapshot *generator = &snapshot.generators[gen];
+        if (!in_range(BEATS_IDX, generator->beats) || !in_range(ONSETS_IDX, generator->onsets) ||
+            !in_range(ROTATION_IDX, generator->rotation) || !in_range(BARS_IDX, generator->size_in_bars) ||
+            !in_range(CHANNEL_IDX, generator->channel + 1) || !in_range(NOTE_IDX, generator->note) ||
+            !in_range(VELOCITY_IDX, generator->velocity) || !in_range(GATE_IDX, generator->gate) ||
+            !in_range(SWING_IDX, generator->swing) || !in_range(TIMING_IDX, generator->timing) ||
+            !in_range(DYNAMICS_IDX, generator->dynamics) || !in_range(COMBINATION_IDX, generator->combination) ||
+            !in_range(FIRST_IDX, generator->first) || !in_range(SECOND_IDX, generator->second)) {
+            lv2_log_error(&self->logger, "Ignoring a snapshot with generator %d out of range\n", gen);
+            return LV2_STATE_ERR_BAD_TYPE;
+        }
+    }
+
+    // The patterns are computed again from the parameters, rather than taken from the snapshot: every instance shares
+    // the cache, and a corrupt snapshot mustn't put a wrong pattern in it. Those saved only have to agree with them.
+    const Pattern_entry *entries[N_GENERATORS];
+    bool agree = true;
+    for (unsigned short gen = 0; gen < N_GENERATORS; ++gen) {
+        const Generator_snapshot *generator = &snapshot.generators[gen];
+        const Generator_snapshot *first = &snapshot.generators[generator->first];
+        const Generator_snapshot *second = &snapshot.generators[generator->second];
+        const Pattern_request request = {
+                gen,
+                0,
+                generator->onsets,
+                generator->beats,
+                generator->rotation,
+                generator->size_in_bars,
+                generator->combination,
+                {{first->onsets, first->beats, first->rotation}, {second->onsets, second->beats, second->rotation}},
+        };
+        Pattern_layout layout;
+        compute_pattern(self, &request, &layout);
+        entries[gen] = layout.entry;
+        agree = agree && entries[gen] != NULL &&
+                (!generator->has_pattern || !memcmp(&entries[gen]->euclidean, &generator->euclidean, sizeof(pattern)));
+    }
+    if (!agree) {
+        for (unsigned short gen = 0; gen < N_GENERATORS; ++gen) {
+            pattern_cache_release(entries[gen]);
+        }
+        lv2_log_error(&self->logger, "Ignoring a snapshot whose patterns don't follow from its parameters\n");
+        return LV2_STATE_ERR_BAD_TYPE;
+    }
+
+    // A restore that run() hasn't got to yet is simply replaced
+    __atomic_store_n(&self->restore_pending, false, __ATOMIC_RELAXED);
+    self->restored = snapshot;
+    for (unsigned short gen = 0; gen < N_GENERATORS; ++gen) {
+        pattern_cache_release(__atomic_exchange_n(&self->restored_entries[gen], entries[gen], __ATOMIC_RELEASE));
+    }
+    __atomic_store_n(&self->restore_pending, true, __ATOMIC_RELEASE);
+    return LV2_STATE_SUCCESS;
+}
+
+static const void *extension_data(const char *uri) {
+    static const LV2_Worker_Interface worker = {work, work_response, end_run};
+    static const LV2_State_Interface state = {save, restore};
+    if (!strcmp(uri, LV2_WORKER__interface)) {
+        return &worker;
+    }
+    if (!strcmp(uri, LV2_STATE__interface)) {
+        return &state;
     }
+    return NULL;
 }
 
 // clang-format off
@@ -429,11 +2115,11 @@ static const LV2_Descriptor descriptor = {
         EUCLIDEAN_URI,
         instantiate,
         connect_port,
-        NULL,   // activate
+        activate,
         run,
-        NULL, // deactivate,
+        deactivate,
         cleanup,
-        NULL, // extension_data
+        extension_data,
 };
 // clang-format on
 
@@ -43,7 +43,13 @@ public:
     BWidgets::Text channelLabel;
     BWidgets::Text noteLabel;
     BWidgets::Text velocityLabel;
+    BWidgets::Text gateLabel;
+    BWidgets::Text swingLabel;
+    BWidgets::Text timingLabel;
+    BWidgets::Text dynamicsLabel;
     BWidgets::Text generatorLabels[N_GENERATORS];
+    BWidgets::Text clockLabel;
+    BWidgets::Text tempoLabel;
 
     BWidgets::CheckBox enabledCheckboxes[N_GENERATORS];
     BWidgets::ValueDial beatsDials[N_GENERATORS];
@@ -53,10 +59,16 @@ public:
     BWidgets::ValueDial channelDials[N_GENERATORS];
     BWidgets::ValueDial noteDials[N_GENERATORS];
     BWidgets::ValueDial velocityDials[N_GENERATORS];
+    BWidgets::ValueDial gateDials[N_GENERATORS];
+    BWidgets::ValueDial swingDials[N_GENERATORS];
+    BWidgets::ValueDial timingDials[N_GENERATORS];
+    BWidgets::ValueDial dynamicsDials[N_GENERATORS];
+    BWidgets::CheckBox clockCheckbox;
+    BWidgets::ValueDial tempoDial;
 };
 
 Euclidean_GUI::Euclidean_GUI(PuglNativeView parentWindow) :
-        BWidgets::Window(800, 800, parentWindow, BUtilities::Urid::urid(EUCLIDEAN_UI_URI), "Euclidean Rhythms", true,
+        BWidgets::Window(1160, 890, parentWindow, BUtilities::Urid::urid(EUCLIDEAN_UI_URI), "Euclidean Rhythms", true,
                          PUGL_MODULE, 0),
         write_function(nullptr), controller(nullptr),
         beatsLabel(BWidgets::Text("beats")),
@@ -66,6 +78,10 @@ Euclidean_GUI::Euclidean_GUI(PuglNativeView parentWindow) :
         channelLabel(BWidgets::Text("MIDI channel")),
         noteLabel(BWidgets::Text("MIDI note")),
         velocityLabel(BWidgets::Text("MIDI velocity")),
+        gateLabel(BWidgets::Text("gate (% of step)")),
+        swingLabel(BWidgets::Text("swing (% of step)")),
+        timingLabel(BWidgets::Text("timing (% of step)")),
+        dynamicsLabel(BWidgets::Text("dynamics")),
         generatorLabels{
                 {BWidgets::Text("gen 0")},
                 {BWidgets::Text("gen 1")},
@@ -76,6 +92,8 @@ Euclidean_GUI::Euclidean_GUI(PuglNativeView parentWindow) :
                 {BWidgets::Text("gen 6")},
                 {BWidgets::Text("gen 7")},
         },
+        clockLabel(BWidgets::Text("internal clock")),
+        tempoLabel(BWidgets::Text("tempo (bpm)")),
         enabledCheckboxes{
                 {BWidgets::CheckBox(true, true, 2 + N_PARAMETERS * 0)},
                 {BWidgets::CheckBox(true, false, 2 + N_PARAMETERS * 1)},
@@ -87,34 +105,34 @@ Euclidean_GUI::Euclidean_GUI(PuglNativeView parentWindow) :
                 {BWidgets::CheckBox(true, false, 2 + N_PARAMETERS * 7)},
         },
         beatsDials{
-                {BWidgets::ValueDial(8, 2, 64, 1, 3 + N_PARAMETERS * 0)},
-                {BWidgets::ValueDial(8, 2, 64, 1, 3 + N_PARAMETERS * 1)},
-                {BWidgets::ValueDial(8, 2, 64, 1, 3 + N_PARAMETERS * 2)},
-                {BWidgets::ValueDial(8, 2, 64, 1, 3 + N_PARAMETERS * 3)},
-                {BWidgets::ValueDial(8, 2, 64, 1, 3 + N_PARAMETERS * 4)},
-                {BWidgets::ValueDial(8, 2, 64, 1, 3 + N_PARAMETERS * 5)},
-                {BWidgets::ValueDial(8, 2, 64, 1, 3 + N_PARAMETERS * 6)},
-                {BWidgets::ValueDial(8, 2, 64, 1, 3 + N_PARAMETERS * 7)},
+                {BWidgets::ValueDial(8, 2, 512, 1, 3 + N_PARAMETERS * 0)},
+                {BWidgets::ValueDial(8, 2, 512, 1, 3 + N_PARAMETERS * 1)},
+                {BWidgets::ValueDial(8, 2, 512, 1, 3 + N_PARAMETERS * 2)},
+                {BWidgets::ValueDial(8, 2, 512, 1, 3 + N_PARAMETERS * 3)},
+                {BWidgets::ValueDial(8, 2, 512, 1, 3 + N_PARAMETERS * 4)},
+                {BWidgets::ValueDial(8, 2, 512, 1, 3 + N_PARAMETERS * 5)},
+                {BWidgets::ValueDial(8, 2, 512, 1, 3 + N_PARAMETERS * 6)},
+                {BWidgets::ValueDial(8, 2, 512, 1, 3 + N_PARAMETERS * 7)},
         },
         onsetsDials{
-                {BWidgets::ValueDial(5, 0, 64, 1, 4 + N_PARAMETERS * 0)},
-                {BWidgets::ValueDial(5, 0, 64, 1, 4 + N_PARAMETERS * 1)},
-                {BWidgets::ValueDial(5, 0, 64, 1, 4 + N_PARAMETERS * 2)},
-                {BWidgets::ValueDial(5, 0, 64, 1, 4 + N_PARAMETERS * 3)},
-                {BWidgets::ValueDial(5, 0, 64, 1, 4 + N_PARAMETERS * 4)},
-                {BWidgets::ValueDial(5, 0, 64, 1, 4 + N_PARAMETERS * 5)},
-                {BWidgets::ValueDial(5, 0, 64, 1, 4 + N_PARAMETERS * 6)},
-                {BWidgets::ValueDial(5, 0, 64, 1, 4 + N_PARAMETERS * 7)},
+                {BWidgets::ValueDial(5, 0, 512, 1, 4 + N_PARAMETERS * 0)},
+                {BWidgets::ValueDial(5, 0, 512, 1, 4 + N_PARAMETERS * 1)},
+                {BWidgets::ValueDial(5, 0, 512, 1, 4 + N_PARAMETERS * 2)},
+                {BWidgets::ValueDial(5, 0, 512, 1, 4 + N_PARAMETERS * 3)},
+                {BWidgets::ValueDial(5, 0, 512, 1, 4 + N_PARAMETERS * 4)},
+                {BWidgets::ValueDial(5, 0, 512, 1, 4 + N_PARAMETERS * 5)},
+                {BWidgets::ValueDial(5, 0, 512, 1, 4 + N_PARAMETERS * 6)},
+                {BWidgets::ValueDial(5, 0, 512, 1, 4 + N_PARAMETERS * 7)},
         },
         rotationDials{
-                {BWidgets::ValueDial(0, -32, 31, 1, 5 + N_PARAMETERS * 0)},
-                {BWidgets::ValueDial(0, -32, 31, 1, 5 + N_PARAMETERS * 1)},
-                {BWidgets::ValueDial(0, -32, 31, 1, 5 + N_PARAMETERS * 2)},
-                {BWidgets::ValueDial(0, -32, 31, 1, 5 + N_PARAMETERS * 3)},
-                {BWidgets::ValueDial(0, -32, 31, 1, 5 + N_PARAMETERS * 4)},
-                {BWidgets::ValueDial(0, -32, 31, 1, 5 + N_PARAMETERS * 5)},
-                {BWidgets::ValueDial(0, -32, 31, 1, 5 + N_PARAMETERS * 6)},
-                {BWidgets::ValueDial(0, -32, 31, 1, 5 + N_PARAMETERS * 7)},
+                {BWidgets::ValueDial(0, -256, 255, 1, 5 + N_PARAMETERS * 0)},
+                {BWidgets::ValueDial(0, -256, 255, 1, 5 + N_PARAMETERS * 1)},
+                {BWidgets::ValueDial(0, -256, 255, 1, 5 + N_PARAMETERS * 2)},
+                {BWidgets::ValueDial(0, -256, 255, 1, 5 + N_PARAMETERS * 3)},
+                {BWidgets::ValueDial(0, -256, 255, 1, 5 + N_PARAMETERS * 4)},
+                {BWidgets::ValueDial(0, -256, 255, 1, 5 + N_PARAMETERS * 5)},
+                {BWidgets::ValueDial(0, -256, 255, 1, 5 + N_PARAMETERS * 6)},
+                {BWidgets::ValueDial(0, -256, 255, 1, 5 + N_PARAMETERS * 7)},
         },
         barsDials{
                 {BWidgets::ValueDial(1, 1, 8, 1, 6 + N_PARAMETERS * 0)},
@@ -155,7 +173,49 @@ Euclidean_GUI::Euclidean_GUI(PuglNativeView parentWindow) :
                 {BWidgets::ValueDial(64, 0, 127, 1, 9 + N_PARAMETERS * 5)},
                 {BWidgets::ValueDial(64, 0, 127, 1, 9 + N_PARAMETERS * 6)},
                 {BWidgets::ValueDial(64, 0, 127, 1, 9 + N_PARAMETERS * 7)},
-        } {
+        },
+        gateDials{
+                {BWidgets::ValueDial(0, 0, MAX_GATE, 1, GATE_PORT(0))},
+                {BWidgets::ValueDial(0, 0, MAX_GATE, 1, GATE_PORT(1))},
+                {BWidgets::ValueDial(0, 0, MAX_GATE, 1, GATE_PORT(2))},
+                {BWidgets::ValueDial(0, 0, MAX_GATE, 1, GATE_PORT(3))},
+                {BWidgets::ValueDial(0, 0, MAX_GATE, 1, GATE_PORT(4))},
+                {BWidgets::ValueDial(0, 0, MAX_GATE, 1, GATE_PORT(5))},
+                {BWidgets::ValueDial(0, 0, MAX_GATE, 1, GATE_PORT(6))},
+                {BWidgets::ValueDial(0, 0, MAX_GATE, 1, GATE_PORT(7))},
+        },
+        swingDials{
+                {BWidgets::ValueDial(0, 0, MAX_SWING, 1, SWING_PORT(0))},
+                {BWidgets::ValueDial(0, 0, MAX_SWING, 1, SWING_PORT(1))},
+                {BWidgets::ValueDial(0, 0, MAX_SWING, 1, SWING_PORT(2))},
+                {BWidgets::ValueDial(0, 0, MAX_SWING, 1, SWING_PORT(3))},
+                {BWidgets::ValueDial(0, 0, MAX_SWING, 1, SWING_PORT(4))},
+                {BWidgets::ValueDial(0, 0, MAX_SWING, 1, SWING_PORT(5))},
+                {BWidgets::ValueDial(0, 0, MAX_SWING, 1, SWING_PORT(6))},
+                {BWidgets::ValueDial(0, 0, MAX_SWING, 1, SWING_PORT(7))},
+        },
+        timingDials{
+                {BWidgets::ValueDial(0, 0, MAX_TIMING, 1, TIMING_PORT(0))},
+                {BWidgets::ValueDial(0, 0, MAX_TIMING, 1, TIMING_PORT(1))},
+                {BWidgets::ValueDial(0, 0, MAX_TIMING, 1, TIMING_PORT(2))},
+                {BWidgets::ValueDial(0, 0, MAX_TIMING, 1, TIMING_PORT(3))},
+                {BWidgets::ValueDial(0, 0, MAX_TIMING, 1, TIMING_PORT(4))},
+                {BWidgets::ValueDial(0, 0, MAX_TIMING, 1, TIMING_PORT(5))},
+                {BWidgets::ValueDial(0, 0, MAX_TIMING, 1, TIMING_PORT(6))},
+                {BWidgets::ValueDial(0, 0, MAX_TIMING, 1, TIMING_PORT(7))},
+        },
+        dynamicsDials{
+                {BWidgets::ValueDial(0, 0, MAX_DYNAMICS, 1, DYNAMICS_PORT(0))},
+                {BWidgets::ValueDial(0, 0, MAX_DYNAMICS, 1, DYNAMICS_PORT(1))},
+                {BWidgets::ValueDial(0, 0, MAX_DYNAMICS, 1, DYNAMICS_PORT(2))},
+                {BWidgets::ValueDial(0, 0, MAX_DYNAMICS, 1, DYNAMICS_PORT(3))},
+                {BWidgets::ValueDial(0, 0, MAX_DYNAMICS, 1, DYNAMICS_PORT(4))},
+                {BWidgets::ValueDial(0, 0, MAX_DYNAMICS, 1, DYNAMICS_PORT(5))},
+                {BWidgets::ValueDial(0, 0, MAX_DYNAMICS, 1, DYNAMICS_PORT(6))},
+                {BWidgets::ValueDial(0, 0, MAX_DYNAMICS, 1, DYNAMICS_PORT(7))},
+        },
+        clockCheckbox(BWidgets::CheckBox(true, false, CLOCK_PORT)),
+        tempoDial(BWidgets::ValueDial(DEFAULT_TEMPO, MIN_TEMPO, MAX_TEMPO, 1, TEMPO_PORT)) {
     beatsLabel.moveTo(50 + 90 * 1, 40);
     add(&beatsLabel);
     onsetsLabel.moveTo(50 + 90 * 2, 40);
@@ -170,6 +230,14 @@ Euclidean_GUI::Euclidean_GUI(PuglNativeView parentWindow) :
     add(&noteLabel);
     velocityLabel.moveTo(30 + 90 * 7, 40);
     add(&velocityLabel);
+    gateLabel.moveTo(24 + 90 * 8, 40);
+    add(&gateLabel);
+    swingLabel.moveTo(22 + 90 * 9, 40);
+    add(&swingLabel);
+    timingLabel.moveTo(20 + 90 * 10, 40);
+    add(&timingLabel);
+    dynamicsLabel.moveTo(40 + 90 * 11, 40);
+    add(&dynamicsLabel);
     for (int i = 0; i < N_GENERATORS; ++i) {
         generatorLabels[i].moveTo(20, 70 + 24 + 90 * i);
         add(&generatorLabels[i]);
@@ -237,11 +305,81 @@ Euclidean_GUI::Euclidean_GUI(PuglNativeView parentWindow) :
         add(&velocityDials[i]);
         velocityDials[i].setCallbackFunction(BEvents::Event::EventType::valueChangedEvent,
                                              Euclidean_GUI::valueChangedCallback);
+
+        gateDials[i].moveTo(30 + 90 * 8, 70 + 90 * i);
+        gateDials[i].setWidth(80);
+        gateDials[i].setHeight(80);
+        gateDials[i].setClickable(false);
+        add(&gateDials[i]);
+        gateDials[i].setCallbackFunction(BEvents::Event::EventType::valueChangedEvent,
+                                         Euclidean_GUI::valueChangedCallback);
+
+        swingDials[i].moveTo(30 + 90 * 9, 70 + 90 * i);
+        swingDials[i].setWidth(80);
+        swingDials[i].setHeight(80);
+        swingDials[i].setClickable(false);
+        add(&swingDials[i]);
+        swingDials[i].setCallbackFunction(BEvents::Event::EventType::valueChangedEvent,
+                                          Euclidean_GUI::valueChangedCallback);
+
+        timingDials[i].moveTo(30 + 90 * 10, 70 + 90 * i);
+        timingDials[i].setWidth(80);
+        timingDials[i].setHeight(80);
+        timingDials[i].setClickable(false);
+        add(&timingDials[i]);
+        timingDials[i].setCallbackFunction(BEvents::Event::EventType::valueChangedEvent,
+                                           Euclidean_GUI::valueChangedCallback);
+
+        dynamicsDials[i].moveTo(30 + 90 * 11, 70 + 90 * i);
+        dynamicsDials[i].setWidth(80);
+        dynamicsDials[i].setHeight(80);
+        dynamicsDials[i].setClickable(false);
+        add(&dynamicsDials[i]);
+        dynamicsDials[i].setCallbackFunction(BEvents::Event::EventType::valueChangedEvent,
+                                             Euclidean_GUI::valueChangedCallback);
     }
+
+    // the clock, below the generators
+    clockLabel.moveTo(20, 70 + 24 + 90 * N_GENERATORS);
+    add(&clockLabel);
+    clockCheckbox.setValue(false);
+    clockCheckbox.moveTo(30 + 90 * 1 + 32, 70 + 20 + 90 * N_GENERATORS);
+    clockCheckbox.setWidth(16);
+    clockCheckbox.setHeight(16);
+    add(&clockCheckbox);
+    clockCheckbox.setCallbackFunction(BEvents::Event::EventType::valueChangedEvent,
+                                      Euclidean_GUI::valueChangedCallback);
+    tempoLabel.moveTo(30 + 90 * 2, 70 + 24 + 90 * N_GENERATORS);
+    add(&tempoLabel);
+    tempoDial.moveTo(30 + 90 * 3, 70 + 90 * N_GENERATORS);
+    tempoDial.setWidth(80);
+    tempoDial.setHeight(80);
+    tempoDial.setClickable(false);
+    add(&tempoDial);
+    tempoDial.setCallbackFunction(BEvents::Event::EventType::valueChangedEvent, Euclidean_GUI::valueChangedCallback);
 }
 
 void Euclidean_GUI::portEvent(uint32_t port_index, uint32_t buffer_size, uint32_t format, const void *buffer) {
-    if (format == 0) {
+    if (format == 0 && port_index == CLOCK_PORT) {
+        clockCheckbox.setValue(*(float *) buffer > 0);
+    } else if (format == 0 && port_index == TEMPO_PORT) {
+        tempoDial.setValue(*(float *) buffer);
+    } else if (format == 0 && port_index >= GATE_PORT(0) && port_index < GATE_PORT(N_GENERATORS)) {
+        gateDials[port_index - GATE_PORT(0)].setValue(*(float *) buffer);
+    } else if (format == 0 && port_index >= SWING_PORT(0) && port_index < SWING_PORT(N_GENERATORS)) {
+        const unsigned short generator = (port_index - SWING_PORT(0)) / 3;
+        switch (port_index - SWING_PORT(generator)) {
+            case 0:
+                swingDials[generator].setValue(*(float *) buffer);
+                break;
+            case 1:
+                timingDials[generator].setValue(*(float *) buffer);
+                break;
+            default:
+                dynamicsDials[generator].setValue(*(float *) buffer);
+                break;
+        }
+    } else if (format == 0 && port_index >= 2 && port_index < NOTIFY_PORT) {
         auto *pval = (float *) buffer;
         unsigned short generator = (port_index - 2) / N_PARAMETERS;
         unsigned short widget_offset = (port_index - 2) % N_PARAMETERS;
@@ -284,7 +422,8 @@ void Euclidean_GUI::valueChangedCallback(BEvents::Event *event) {
         auto port_index = widget->getUrid();
 
         float value;
-        if ((port_index - 2) % N_PARAMETERS == 0) {  // an on/off switch
+        if ((port_index < NOTIFY_PORT && (port_index - 2) % N_PARAMETERS == 0) ||
+            port_index == CLOCK_PORT) {  // an on/off switch
             auto *vd = dynamic_cast<BWidgets::ValueableTyped<bool> *>(widget);
             if (!vd) return;
             value = vd->getValue() ? 1.0 : 0.0;
@@ -0,0 +1,96 @@
+/*
+ * Copyright 2023, 2024 by Bruno Unna.
+ *
+ * This file is part of Euclidean Rhythms.
+ *
+ * Euclidean Rhythms is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * Euclidean Rhythms is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with Euclidean Rhythms.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Builds the pattern database that goes in the bundle (that's how the build uses it), and shows what is in one
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pattern_db.h"
+
+static void usage(const char *program) {
+    fprintf(stderr,
+            "Usage: %s -b OUTPUT [MAX_BEATS]\n"
+            "       %s BUNDLE BEATS [ONSETS]\n"
+            "\n"
+            "The first form builds a database of the patterns of up to MAX_BEATS beats (default %d). The second one\n"
+            "lists, from the database of a bundle, the patterns of BEATS beats (or only the one with ONSETS onsets).\n",
+            program, program, MAX_BEATS);
+}
+
+static bool parse_number(const char *text, long maximum, unsigned short *number) {
+    char *end;
+    const long value = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || value < 0 || value > maximum) {
+        return false;
+    }
+    *number = (unsigned short) value;
+    return true;
+}
+
+static void print_record(const Pattern_db *db, const Pattern_db_record *record) {
+    pattern p;
+    pattern_db_find(db, record->onsets, record->beats, 0, &p);
+
+    printf("E(%d, %d) [", record->onsets, record->beats);
+    for (unsigned short beat = 0; beat < record->beats; ++beat) {
+        putchar(pattern_test(&p, beat) ? 'x' : '.');
+    }
+    printf("] necklace %u, canonical rotation %d, period %d, evenness %.4f, deviation %.4f\n",
+           record->necklace, record->canonical_rotation, record->period, record->evenness, record->deviation);
+}
+
+int main(int argc, char **argv) {
+    if (argc >= 3 && argc <= 4 && !strcmp(argv[1], "-b")) {
+        unsigned short max_beats = MAX_BEATS;
+        if (argc == 4 && (!parse_number(argv[3], MAX_BEATS, &max_beats) || max_beats == 0)) {
+            usage(argv[0]);
+            return 1;
+        }
+        if (!pattern_db_build(argv[2], max_beats)) {
+            fprintf(stderr, "%s: could not write %s\n", argv[0], argv[2]);
+            return 1;
+        }
+        return 0;
+    }
+
+    unsigned short beats, onsets = 0;
+    if (argc < 3 || argc > 4 || !parse_number(argv[2], MAX_BEATS, &beats) ||
+        (argc == 4 && !parse_number(argv[3], MAX_BEATS, &onsets))) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Pattern_db db;
+    if (!pattern_db_open(&db, argv[1])) {
+        fprintf(stderr, "%s: no usable %s in %s\n", argv[0], PATTERN_DB_FILE, argv[1]);
+        return 1;
+    }
+    int status = 0;
+    for (unsigned short k = argc == 4 ? onsets : 0; k <= (argc == 4 ? onsets : beats); ++k) {
+        const Pattern_db_record *record = pattern_db_record(&db, k, beats);
+        if (record == NULL) {
+            fprintf(stderr, "%s: E(%d, %d) is not in the database\n", argv[0], k, beats);
+            status = 1;
+            break;
+        }
+        print_record(&db, record);
+    }
+    pattern_db_close(&db);
+    return status;
+}
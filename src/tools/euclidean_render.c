@@ -0,0 +1,437 @@
+/*
+ * Copyright 2023, 2024 by Bruno Unna.
+ *
+ * This file is part of Euclidean Rhythms.
+ *
+ * Euclidean Rhythms is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * Euclidean Rhythms is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with Euclidean Rhythms.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Renders what the plugin plays to a Standard MIDI File, without a host and as fast as the machine can go. The plugin
+// itself is linked in and driven block by block, so that the notes are exactly those it would play in a host.
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <lv2/lv2plug.in/ns/ext/atom/forge.h>
+#include <lv2/lv2plug.in/ns/ext/atom/util.h>
+#include <lv2/lv2plug.in/ns/ext/log/log.h>
+#include <lv2/lv2plug.in/ns/ext/time/time.h>
+#include <lv2/lv2plug.in/ns/ext/urid/urid.h>
+#include <lv2/lv2plug.in/ns/lv2core/lv2.h>
+
+#include "euclidean.h"
+#include "pattern_db.h"
+
+#define BLOCK_FRAMES 4096
+#define CONTROL_CAPACITY 1024
+#define MIDI_OUT_CAPACITY (1 << 20)
+#define TICKS_PER_BEAT 960
+#define MAX_TEMPO_CHANGES 256
+#define MAX_URIS 64
+#define WRITE_BUFFER_SIZE (1 << 20)
+
+// Where the bundle is installed, for its pattern database (the build says where)
+#ifndef EUCLIDEAN_BUNDLE
+#define EUCLIDEAN_BUNDLE "."
+#endif
+
+// The plugin's entry point, linked in rather than loaded
+const LV2_Descriptor *lv2_descriptor(uint32_t index);
+
+typedef struct {
+    long bar;
+    double beats_per_minute;
+} Tempo_change;
+
+typedef struct {
+    char *uris[MAX_URIS];
+    uint32_t n_uris;
+    LV2_URID log_Error;     // the only messages of the plugin worth showing
+} URI_table;
+
+typedef struct {
+    FILE *file;
+    long length_position;   // of the length of the track chunk, filled in when the track is complete
+    uint32_t length;
+    uint64_t tick;          // of the last event written
+} MIDI_writer;
+
+static LV2_URID map_uri(LV2_URID_Map_Handle handle, const char *uri) {
+    URI_table *table = (URI_table *) handle;
+    for (uint32_t i = 0; i < table->n_uris; ++i) {
+        if (!strcmp(table->uris[i], uri)) {
+            return i + 1;
+        }
+    }
+    if (table->n_uris == MAX_URIS) {
+        return 0;
+    }
+    char *copy = malloc(strlen(uri) + 1);
+    if (!copy) {
+        return 0;
+    }
+    table->uris[table->n_uris] = strcpy(copy, uri);
+    return ++table->n_uris;
+}
+
+static int vprintf_log(LV2_Log_Handle handle, LV2_URID type, const char *fmt, va_list ap) {
+    const URI_table *table = (const URI_table *) handle;
+    return type == table->log_Error ? vfprintf(stderr, fmt, ap) : 0;
+}
+
+static int printf_log(LV2_Log_Handle handle, LV2_URID type, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    const int written = vprintf_log(handle, type, fmt, ap);
+    va_end(ap);
+    return written;
+}
+
+static void write_bytes(MIDI_writer *writer, const uint8_t *bytes, uint32_t size) {
+    fwrite(bytes, 1, size, writer->file);
+    writer->length += size;
+}
+
+static void write_quantity(MIDI_writer *writer, uint64_t quantity) {
+    uint8_t bytes[10];
+    int n = 0;
+    bytes[n++] = quantity & 0x7f;
+    while ((quantity >>= 7) != 0) {
+        bytes[n++] = 0x80 | (quantity & 0x7f);
+    }
+    while (n > 0) {
+        const uint8_t byte = bytes[--n];
+        write_bytes(writer, &byte, 1);
+    }
+}
+
+static void write_event(MIDI_writer *writer, uint64_t tick, const uint8_t *bytes, uint32_t size) {
+    // rounding may put an event a tick before one that was played earlier
+    if (tick < writer->tick) {
+        tick = writer->tick;
+    }
+    write_quantity(writer, tick - writer->tick);
+    write_bytes(writer, bytes, size);
+    writer->tick = tick;
+}
+
+// A file of format 0 (a single track), whose length is only known when the track is complete
+static bool begin_file(MIDI_writer *writer, const char *path) {
+    static const uint8_t header[] = {'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 0, 0, 1,
+                                     TICKS_PER_BEAT >> 8, TICKS_PER_BEAT & 0xff,
+                                     'M', 'T', 'r', 'k', 0, 0, 0, 0};
+    writer->file = fopen(path, "wb");
+    if (!writer->file) {
+        return false;
+    }
+    setvbuf(writer->file, NULL, _IOFBF, WRITE_BUFFER_SIZE);
+    fwrite(header, 1, sizeof(header), writer->file);
+    writer->length_position = sizeof(header) - 4;
+    writer->length = 0;
+    writer->tick = 0;
+    return true;
+}
+
+static bool end_file(MIDI_writer *writer) {
+    static const uint8_t end_of_track[] = {0xff, 0x2f, 0x00};
+    write_event(writer, writer->tick, end_of_track, sizeof(end_of_track));
+
+    const uint8_t length[] = {writer->length >> 24, (writer->length >> 16) & 0xff, (writer->length >> 8) & 0xff,
+                              writer->length & 0xff};
+    bool ok = fseek(writer->file, writer->length_position, SEEK_SET) == 0 &&
+              fwrite(length, 1, sizeof(length), writer->file) == sizeof(length);
+    ok = !ferror(writer->file) && ok;
+    return fclose(writer->file) == 0 && ok;
+}
+
+static void usage(const char *program) {
+    fprintf(stderr,
+            "Usage: %s [options] -g GENERATOR [-g GENERATOR ...] OUTPUT.mid\n"
+            "\n"
+            "  -g ONSETS,BEATS[,ROTATION[,BARS[,CHANNEL[,NOTE[,VELOCITY]]]]]\n"
+            "                 add a generator (up to %d)\n"
+            "  -t [BAR:]BPM   tempo from the given bar on (default 120 from bar 0)\n"
+            "  -m BEATS       beats per bar (default 4)\n"
+            "  -l BARS        length of the rendering, in bars (default 8)\n"
+            "  -r RATE        sample rate the plugin runs at (default 48000)\n"
+            "  -b BUNDLE      bundle with the pattern database (default %s)\n",
+            program, N_GENERATORS, EUCLIDEAN_BUNDLE);
+}
+
+// Parse a list of comma separated numbers into the ports of a generator, from its number of onsets on
+static bool parse_generator(const char *text, float *ports) {
+    static const int order[] = {ONSETS_IDX, BEATS_IDX, ROTATION_IDX, BARS_IDX, CHANNEL_IDX, NOTE_IDX, VELOCITY_IDX};
+    int n = 0;
+    const char *p = text;
+    for (;;) {
+        char *end;
+        const long value = strtol(p, &end, 10);
+        if (end == p || n == (int) (sizeof(order) / sizeof(order[0]))) {
+            return false;
+        }
+        ports[order[n++]] = (float) value;
+        if (*end == '\0') {
+            break;
+        }
+        if (*end != ',') {
+            return false;
+        }
+        p = end + 1;
+    }
+    return n >= 2;
+}
+
+static bool parse_tempo(const char *text, Tempo_change *change) {
+    char *end;
+    const char *colon = strchr(text, ':');
+    change->bar = 0;
+    if (colon) {
+        change->bar = strtol(text, &end, 10);
+        if (end != colon || change->bar < 0) {
+            return false;
+        }
+        text = colon + 1;
+    }
+    change->beats_per_minute = strtod(text, &end);
+    return end != text && *end == '\0' && change->beats_per_minute > 0;
+}
+
+static int compare_tempo_changes(const void *a, const void *b) {
+    const long bar_a = ((const Tempo_change *) a)->bar;
+    const long bar_b = ((const Tempo_change *) b)->bar;
+    return bar_a < bar_b ? -1 : bar_a > bar_b;
+}
+
+int main(int argc, char **argv) {
+    static float ports[N_GENERATORS][N_PARAMETERS];
+    static Tempo_change tempo[MAX_TEMPO_CHANGES];
+    static uint8_t control[CONTROL_CAPACITY] __attribute__((aligned(8)));
+    static uint8_t midi_out[MIDI_OUT_CAPACITY] __attribute__((aligned(8)));
+
+    int n_generators = 0;
+    int n_tempo_changes = 0;
+    long beats_per_bar = 4;
+    long length_in_bars = 8;
+    double rate = 48000;
+    const char *bundle = EUCLIDEAN_BUNDLE;
+    const char *output = NULL;
+
+    for (unsigned short gen = 0; gen < N_GENERATORS; ++gen) {
+        ports[gen][ENABLED_IDX] = 0;
+        ports[gen][BEATS_IDX] = 8;
+        ports[gen][ONSETS_IDX] = 5;
+        ports[gen][ROTATION_IDX] = 0;
+        ports[gen][BARS_IDX] = 1;
+        ports[gen][CHANNEL_IDX] = 10;
+        ports[gen][NOTE_IDX] = 48;
+        ports[gen][VELOCITY_IDX] = 64;
+    }
+
+    for (int i = 1; i < argc; ++i) {
+        const char *option = argv[i];
+        if (option[0] != '-' || option[1] == '\0') {
+            if (output) {
+                usage(argv[0]);
+                return 1;
+            }
+            output = option;
+            continue;
+        }
+        if (option[2] != '\0' || i + 1 == argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        const char *value = argv[++i];
+        char *end;
+        bool ok;
+        switch (option[1]) {
+            case 'g':
+                ok = n_generators < N_GENERATORS && parse_generator(value, ports[n_generators]);
+                if (ok) {
+                    ports[n_generators++][ENABLED_IDX] = 1;
+                }
+                break;
+            case 't':
+                ok = n_tempo_changes < MAX_TEMPO_CHANGES - 1 && parse_tempo(value, &tempo[n_tempo_changes++]);
+                break;
+            case 'm':
+                beats_per_bar = strtol(value, &end, 10);
+                ok = *end == '\0' && beats_per_bar > 0 && beats_per_bar < 256;
+                break;
+            case 'l':
+                length_in_bars = strtol(value, &end, 10);
+                ok = *end == '\0' && length_in_bars > 0;
+                break;
+            case 'r':
+                rate = strtod(value, &end);
+                ok = *end == '\0' && rate > 0;
+                break;
+            case 'b':
+                bundle = value;
+                ok = true;
+                break;
+            default:
+                ok = false;
+                break;
+        }
+        if (!ok) {
+            fprintf(stderr, "%s: invalid option %s %s\n", argv[0], option, value);
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!output || n_generators == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // The tempo map always starts at bar 0 (there is room left for that)
+    qsort(tempo, n_tempo_changes, sizeof(Tempo_change), compare_tempo_changes);
+    if (n_tempo_changes == 0 || tempo[0].bar != 0) {
+        memmove(tempo + 1, tempo, n_tempo_changes * sizeof(Tempo_change));
+        tempo[0].bar = 0;
+        tempo[0].beats_per_minute = 120;
+        n_tempo_changes++;
+    }
+
+    // A host with nothing to offer but the URID map and a log
+    URI_table uri_table = {{NULL}, 0, 0};
+    LV2_URID_Map map = {&uri_table, map_uri};
+    uri_table.log_Error = map_uri(&uri_table, LV2_LOG__Error);
+    LV2_Log_Log log = {&uri_table, printf_log, vprintf_log};
+    const LV2_Feature map_feature = {LV2_URID__map, &map};
+    const LV2_Feature log_feature = {LV2_LOG__log, &log};
+    const LV2_Feature *features[] = {&map_feature, &log_feature, NULL};
+
+    // The plugin does without the database, only slower
+    Pattern_db db;
+    if (pattern_db_open(&db, bundle)) {
+        pattern_db_close(&db);
+    } else {
+        fprintf(stderr, "%s: no usable %s in %s, computing the patterns instead\n", argv[0], PATTERN_DB_FILE, bundle);
+    }
+
+    const LV2_Descriptor *descriptor = lv2_descriptor(0);
+    LV2_Handle plugin = descriptor->instantiate(descriptor, rate, bundle, features);
+    if (!plugin) {
+        fprintf(stderr, "%s: could not instantiate the plugin\n", argv[0]);
+        return 1;
+    }
+    descriptor->connect_port(plugin, CONTROL_PORT, control);
+    descriptor->connect_port(plugin, MIDI_OUT_PORT, midi_out);
+    for (unsigned short gen = 0; gen < N_GENERATORS; ++gen) {
+        for (unsigned short parameter = 0; parameter < N_PARAMETERS; ++parameter) {
+            descriptor->connect_port(plugin, 2 + gen * N_PARAMETERS + parameter, &ports[gen][parameter]);
+        }
+    }
+    descriptor->activate(plugin);
+
+    MIDI_writer writer;
+    if (!begin_file(&writer, output)) {
+        fprintf(stderr, "%s: could not open %s\n", argv[0], output);
+        descriptor->cleanup(plugin);
+        return 1;
+    }
+
+    const uint8_t time_signature[] = {0xff, 0x58, 0x04, (uint8_t) beats_per_bar, 2, 24, 8};
+    write_event(&writer, 0, time_signature, sizeof(time_signature));
+
+    LV2_Atom_Forge forge;
+    lv2_atom_forge_init(&forge, &map);
+    const LV2_URID time_Position = map_uri(&uri_table, LV2_TIME__Position);
+    const LV2_URID time_frame = map_uri(&uri_table, LV2_TIME__frame);
+    const LV2_URID time_speed = map_uri(&uri_table, LV2_TIME__speed);
+    const LV2_URID time_beatsPerMinute = map_uri(&uri_table, LV2_TIME__beatsPerMinute);
+    const LV2_URID time_beatsPerBar = map_uri(&uri_table, LV2_TIME__beatsPerBar);
+    const LV2_URID time_bar = map_uri(&uri_table, LV2_TIME__bar);
+    const LV2_URID time_barBeat = map_uri(&uri_table, LV2_TIME__barBeat);
+
+    // Each stretch of constant tempo starts with the transport position, as a host would send it
+    long frame = 0;
+    for (int k = 0; k < n_tempo_changes && tempo[k].bar < length_in_bars; ++k) {
+        const bool last_stretch = k + 1 == n_tempo_changes || tempo[k + 1].bar >= length_in_bars;
+        const long end_bar = last_stretch ? length_in_bars : tempo[k + 1].bar;
+        const double bpm = tempo[k].beats_per_minute;
+        const double frames_per_beat = 60 * rate / bpm;
+        const double start_beat = (double) tempo[k].bar * beats_per_bar;
+        const long start_frame = frame;
+        long end_frame = start_frame + lround((end_bar - tempo[k].bar) * beats_per_bar * frames_per_beat);
+
+        const uint32_t microseconds_per_beat = (uint32_t) lround(60e6 / bpm);
+        const uint8_t set_tempo[] = {0xff, 0x51, 0x03, microseconds_per_beat >> 16,
+                                     (microseconds_per_beat >> 8) & 0xff, microseconds_per_beat & 0xff};
+        write_event(&writer, (uint64_t) llround(start_beat * TICKS_PER_BEAT), set_tempo, sizeof(set_tempo));
+
+        while (frame < end_frame) {
+            const uint32_t n_frames = (uint32_t) (end_frame - frame < BLOCK_FRAMES ? end_frame - frame : BLOCK_FRAMES);
+
+            lv2_atom_forge_set_buffer(&forge, control, sizeof(control));
+            LV2_Atom_Forge_Frame sequence_frame;
+            lv2_atom_forge_sequence_head(&forge, &sequence_frame, 0);
+            if (frame == start_frame) {
+                LV2_Atom_Forge_Frame object_frame;
+                lv2_atom_forge_frame_time(&forge, 0);
+                lv2_atom_forge_object(&forge, &object_frame, 0, time_Position);
+                lv2_atom_forge_key(&forge, time_frame);
+                lv2_atom_forge_long(&forge, frame);
+                lv2_atom_forge_key(&forge, time_speed);
+                lv2_atom_forge_float(&forge, 1);
+                lv2_atom_forge_key(&forge, time_beatsPerMinute);
+                lv2_atom_forge_float(&forge, (float) bpm);
+                lv2_atom_forge_key(&forge, time_beatsPerBar);
+                lv2_atom_forge_float(&forge, (float) beats_per_bar);
+                lv2_atom_forge_key(&forge, time_bar);
+                lv2_atom_forge_long(&forge, tempo[k].bar);
+                lv2_atom_forge_key(&forge, time_barBeat);
+                lv2_atom_forge_float(&forge, 0);
+                lv2_atom_forge_pop(&forge, &object_frame);
+            }
+            lv2_atom_forge_pop(&forge, &sequence_frame);
+
+            ((LV2_Atom *) midi_out)->size = sizeof(midi_out) - sizeof(LV2_Atom);
+            descriptor->run(plugin, n_frames);
+
+            LV2_ATOM_SEQUENCE_FOREACH((const LV2_Atom_Sequence *) midi_out, ev) {
+                const uint8_t *msg = (const uint8_t *) LV2_ATOM_BODY_CONST(&ev->body);
+                const double beat = start_beat + (frame + ev->time.frames - start_frame) / frames_per_beat;
+                write_event(&writer, (uint64_t) llround(beat * TICKS_PER_BEAT), msg, ev->body.size);
+            }
+            frame += n_frames;
+
+            // Once the rendering is over, keep going just long enough for the notes still playing to end
+            if (last_stretch && frame == end_frame && n_generators > 0) {
+                for (unsigned short gen = 0; gen < N_GENERATORS; ++gen) {
+                    ports[gen][ENABLED_IDX] = 0;
+                }
+                n_generators = 0;
+                end_frame += lround(frames_per_beat);
+            }
+        }
+    }
+
+    descriptor->deactivate(plugin);
+    descriptor->cleanup(plugin);
+    for (uint32_t i = 0; i < uri_table.n_uris; ++i) {
+        free(uri_table.uris[i]);
+    }
+
+    if (!end_file(&writer)) {
+        fprintf(stderr, "%s: could not write %s\n", argv[0], output);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,225 @@
+/*
+ * Copyright 2023, 2024 by Bruno Unna.
+ *
+ * This file is part of Euclidean Rhythms.
+ *
+ * Euclidean Rhythms is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * Euclidean Rhythms is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with Euclidean Rhythms.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Microbenchmarks of the algorithm and of the plugin. The results are printed as JSON, one benchmark per line.
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <time.h>
+
+// The plugin is included rather than linked, to get at the functions it doesn't export (and its cycles())
+#include "../src/plugins/plugin_lv2.c"
+#include "lv2_host.h"
+
+// How long (in nanoseconds) each benchmark runs for, at least
+#define MINIMUM_DURATION 2e7
+
+#define CONTROL_CAPACITY 1024
+#define MIDI_OUT_CAPACITY 65536
+
+typedef struct {
+    LV2_Handle instance;
+    float ports[N_GENERATORS][N_PARAMETERS];
+    uint8_t control[CONTROL_CAPACITY] __attribute__((aligned(8)));
+    uint8_t midi_out[MIDI_OUT_CAPACITY] __attribute__((aligned(8)));
+    uint32_t block_size;
+} Bench_plugin;
+
+static volatile uint64_t sink;
+static bool first_result = true;
+static Test_host host;
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+// Run `operation` for long enough to be measured, and report the cost of each of the `ops_per_call` things it does
+static void measure(const char *name, const char *parameters, void (*operation)(void *), void *argument,
+                    long ops_per_call) {
+    operation(argument);
+
+    long calls = 1;
+    double elapsed;
+    uint64_t elapsed_cycles;
+    for (;;) {
+        const double start = now();
+        const uint64_t start_cycles = cycles();
+        for (long i = 0; i < calls; ++i) {
+            operation(argument);
+        }
+        elapsed_cycles = cycles() - start_cycles;
+        elapsed = now() - start;
+        if (elapsed >= MINIMUM_DURATION || calls >= (1L << 30)) {
+            break;
+        }
+        calls *= 2;
+    }
+
+    const double ops = (double) calls * ops_per_call;
+    printf("%s\n  {\"name\": \"%s\", \"parameters\": \"%s\", \"iterations\": %.0f, \"ns_per_op\": %.3f, ",
+           first_result ? "{\"benchmarks\": [" : ",", name, parameters, ops, elapsed / ops);
+    if (elapsed_cycles > 0) {
+        printf("\"cycles_per_op\": %.3f}", (double) elapsed_cycles / ops);
+    } else {
+        printf("\"cycles_per_op\": null}");
+    }
+    first_result = false;
+}
+
+// Every single-word pattern: all numbers of beats, all numbers of onsets and all rotations
+static void e_everywhere(void *argument) {
+    (void) argument;
+    uint64_t accumulated = 0;
+    for (unsigned short beats = 1; beats <= WORD_BEATS; ++beats) {
+        for (unsigned short onsets = 0; onsets <= beats; ++onsets) {
+            for (short rotation = 0; rotation < beats; ++rotation) {
+                accumulated ^= e(onsets, beats, rotation);
+            }
+        }
+    }
+    sink = accumulated;
+}
+
+static long e_calls(void) {
+    long calls = 0;
+    for (long beats = 1; beats <= WORD_BEATS; ++beats) {
+        calls += (beats + 1) * beats;
+    }
+    return calls;
+}
+
+static void long_patterns(void *argument) {
+    const unsigned short beats = *(const unsigned short *) argument;
+    pattern p;
+    uint64_t accumulated = 0;
+    for (unsigned short onsets = 1; onsets < beats; onsets += beats / 16) {
+        pattern_euclidean(&p, onsets, beats, (short) onsets);
+        accumulated ^= p.w[0];
+    }
+    sink = accumulated;
+}
+
+static void run_block(void *argument) {
+    Bench_plugin *plugin = (Bench_plugin *) argument;
+    ((LV2_Atom *) plugin->midi_out)->size = MIDI_OUT_CAPACITY - sizeof(LV2_Atom);
+    descriptor.run(plugin->instance, plugin->block_size);
+    sink = ((LV2_Atom *) plugin->midi_out)->size;
+}
+
+// Lay out again the onsets of the generators of the mask in `dirty` (of the instance being benchmarked)
+static Bench_plugin *recalculated_plugin;
+static uint64_t recalculated_generators;
+
+static void recalculate(void *argument) {
+    (void) argument;
+    Euclidean *self = (Euclidean *) recalculated_plugin->instance;
+    self->dirty = recalculated_generators;
+    recalculate_onsets(self);
+}
+
+// An instance with `n_generators` generators playing `onsets` onsets over `beats` beats, with the transport rolling
+static Bench_plugin *start_plugin(unsigned short n_generators, unsigned short onsets, unsigned short beats) {
+    Bench_plugin *plugin = calloc(1, sizeof(Bench_plugin));
+    plugin->instance = descriptor.instantiate(&descriptor, 48000, "", host.features);
+    descriptor.connect_port(plugin->instance, CONTROL_PORT, plugin->control);
+    descriptor.connect_port(plugin->instance, MIDI_OUT_PORT, plugin->midi_out);
+    for (unsigned short gen = 0; gen < N_GENERATORS; ++gen) {
+        float *ports = plugin->ports[gen];
+        ports[ENABLED_IDX] = gen < n_generators;
+        ports[BEATS_IDX] = beats;
+        ports[ONSETS_IDX] = onsets;
+        ports[ROTATION_IDX] = gen;
+        ports[BARS_IDX] = 1;
+        ports[CHANNEL_IDX] = 10;
+        ports[NOTE_IDX] = 36 + gen;
+        ports[VELOCITY_IDX] = 100;
+        for (unsigned short parameter = 0; parameter < N_PARAMETERS; ++parameter) {
+            descriptor.connect_port(plugin->instance, 2 + gen * N_PARAMETERS + parameter, &ports[parameter]);
+        }
+    }
+    descriptor.activate(plugin->instance);
+
+    // The first block tells the plugin where the transport is; the rest don't have anything to say
+    LV2_Atom_Forge forge;
+    LV2_Atom_Forge_Frame sequence_frame;
+    lv2_atom_forge_init(&forge, &host.map);
+    lv2_atom_forge_set_buffer(&forge, plugin->control, sizeof(plugin->control));
+    lv2_atom_forge_sequence_head(&forge, &sequence_frame, 0);
+    host_forge_position(&host, &forge, 0, 0, 1, 120, 4, 0);
+    lv2_atom_forge_pop(&forge, &sequence_frame);
+    plugin->block_size = 64;
+    run_block(plugin);
+
+    lv2_atom_forge_set_buffer(&forge, plugin->control, sizeof(plugin->control));
+    lv2_atom_forge_sequence_head(&forge, &sequence_frame, 0);
+    lv2_atom_forge_pop(&forge, &sequence_frame);
+    return plugin;
+}
+
+static void stop_plugin(Bench_plugin *plugin) {
+    descriptor.deactivate(plugin->instance);
+    descriptor.cleanup(plugin->instance);
+    free(plugin);
+}
+
+int main(void) {
+    char parameters[128];
+    host_init(&host);
+
+    measure("e", "every onsets, beats and rotation up to 64 beats", e_everywhere, NULL, e_calls());
+
+    static const unsigned short long_beats[] = {128, 256, 512};
+    for (size_t i = 0; i < sizeof(long_beats) / sizeof(long_beats[0]); ++i) {
+        unsigned short beats = long_beats[i];
+        snprintf(parameters, sizeof(parameters), "beats=%d", beats);
+        measure("pattern_euclidean", parameters, long_patterns, &beats, 16);
+    }
+
+    for (unsigned short n_generators = 1; n_generators <= N_GENERATORS; n_generators *= 2) {
+        recalculated_plugin = start_plugin(N_GENERATORS, 5, 16);
+        recalculated_generators = ALL_GENERATORS >> (N_GENERATORS - n_generators);
+        snprintf(parameters, sizeof(parameters), "generators=%d onsets=5 beats=16", n_generators);
+        measure("recalculate_onsets", parameters, recalculate, NULL, 1);
+        stop_plugin(recalculated_plugin);
+    }
+
+    for (uint32_t block_size = 32; block_size <= 4096; block_size *= 2) {
+        Bench_plugin *plugin = start_plugin(8, 5, 16);
+        plugin->block_size = block_size;
+        snprintf(parameters, sizeof(parameters), "block=%u generators=8 onsets=5 beats=16", block_size);
+        measure("run", parameters, run_block, plugin, 1);
+        stop_plugin(plugin);
+    }
+
+    // From one onset per bar to one every sixteenth, for every generator there is
+    static const unsigned short densities[] = {1, 4, 8, 16};
+    for (size_t i = 0; i < sizeof(densities) / sizeof(densities[0]); ++i) {
+        Bench_plugin *plugin = start_plugin(N_GENERATORS, densities[i], 16);
+        plugin->block_size = 256;
+        snprintf(parameters, sizeof(parameters), "block=256 generators=%d onsets=%d beats=16", N_GENERATORS,
+                 densities[i]);
+        measure("run", parameters, run_block, plugin, 1);
+        stop_plugin(plugin);
+    }
+
+    printf("\n]}\n");
+    host_free(&host);
+    return 0;
+}
@@ -0,0 +1,677 @@
+/*
+ * Copyright 2023, 2024 by Bruno Unna.
+ *
+ * This file is part of Euclidean Rhythms.
+ *
+ * Euclidean Rhythms is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * Euclidean Rhythms is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with Euclidean Rhythms.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// A headless host that loads the built plugin and plays it through a number of scenarios (tempo ramps, loops, seeks,
+// varying block sizes, patch messages instead of ports, the plugin's own clock, stops), measuring what each call to
+// run() costs and checking every note against the ideal timeline. Every scenario is played without a worker, and then
+// with one.
+// The results are printed as JSON, one scenario per line; the exit status says whether any note was out of place.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <dlfcn.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <lv2/lv2plug.in/ns/ext/atom/util.h>
+#include <lv2/lv2plug.in/ns/lv2core/lv2.h>
+#include <lv2/lv2plug.in/ns/ext/patch/patch.h>
+
+#include "euclidean.h"
+#include "lv2_host.h"
+
+#define SAMPLE_RATE 48000
+#define BEATS_PER_BAR 4
+#define MAX_BLOCK 4096
+#define DEFAULT_BLOCKS 1000000
+#define CONTROL_CAPACITY 32768
+#define MIDI_OUT_CAPACITY 65536
+#define NOTIFY_CAPACITY 4096
+#define FIRST_NOTE 36
+
+// How far (in frames) a note may be from where the timeline puts it
+#define OFFSET_TOLERANCE 1
+
+// The seeks land anywhere in the first ten minutes
+#define SEEK_RANGE (10 * 60 * SAMPLE_RATE)
+
+typedef struct {
+    unsigned short onsets;
+    unsigned short beats;
+    short rotation;
+    unsigned short size_in_bars;
+    pattern pattern;
+    pattern edited;              // with an onset less, as the "edits" scenario leaves it
+    double swap_beat;            // where the edited pattern takes over (INFINITY if it doesn't)
+    double swing;                // how late every other step is, in steps
+    const char *lanes[N_LANES];  // as the scenario sets them (NULL: not at all)
+} Generator;
+
+typedef struct {
+    const char *name;
+    uint32_t min_block;
+    uint32_t max_block;
+    float min_bpm;
+    float max_bpm;
+    double sweep_seconds;        // the tempo goes from min_bpm to max_bpm and back in this time (0: min_bpm always)
+    double loop_beats;           // the transport goes back to the start after this many beats (0: no loop)
+    uint32_t seek_period;        // on average, a seek to a random place every so many blocks (0: no seeks)
+    bool position_every_block;   // otherwise the position is sent only when it changes
+    float gate;                  // of every generator, a percentage of its step
+    bool patches;                // the generators are set up with patch messages, their ports are left as they are
+    bool internal_clock;         // the plugin keeps time by itself, at the tempo of its port, while the host's
+                                 // transport stands still
+    double edit_beat;            // the generators lose an onset about here, to take it from their next repetition
+                                 // on (0: no edits)
+    float swing;                 // of every generator, a percentage of its step
+    float dynamics;              // ...and how much louder or softer its notes may be
+    bool lanes;                  // the generators are given the lanes of `scenario_lanes`
+    bool combinations;           // ...and the combinations of `scenario_combinations`
+    uint32_t stop_period;        // the transport stands still for this many blocks, every other this many blocks
+                                 // (0: it never stops)
+} Scenario;
+
+// What the plugin says about itself on its notify port
+typedef struct {
+    long dropped_events;
+    long late_onsets;
+    long missed_onsets;
+} Telemetry;
+
+typedef struct {
+    double beat;                 // where the current stretch of uninterrupted playback started
+    double half_frame;           // half a frame, in beats, at the tempo then
+} Segment;
+
+static Generator generators[N_GENERATORS] = {
+        {3,  8,  0, 1, {{0}}, {{0}}, 0, 0, {NULL}},
+        {4,  16, 0, 1, {{0}}, {{0}}, 0, 0, {NULL}},
+        {5,  16, 2, 1, {{0}}, {{0}}, 0, 0, {NULL}},
+        {7,  12, 0, 1, {{0}}, {{0}}, 0, 0, {NULL}},
+        {5,  13, 3, 1, {{0}}, {{0}}, 0, 0, {NULL}},
+        {9,  32, 0, 2, {{0}}, {{0}}, 0, 0, {NULL}},
+        {11, 24, 5, 3, {{0}}, {{0}}, 0, 0, {NULL}},
+        {16, 16, 0, 1, {{0}}, {{0}}, 0, 0, {NULL}},
+};
+
+static const Scenario scenarios[] = {
+        {"steady",      256, 256,       120, 120, 0,  0,    0,    false, 0,   false, false, 0,   0,  0,  false, false, 0},
+        {"block sizes", 1,   MAX_BLOCK, 120, 120, 0,  0,    0,    true,  0,   false, false, 0,   0,  0,  false, false, 0},
+        {"tempo ramp",  256, 256,       60,  180, 30, 0,    0,    true,  0,   false, false, 0,   0,  0,  false, false, 0},
+        {"loop",        512, 512,       120, 120, 0,  14.3, 0,    true,  0,   false, false, 0,   0,  0,  false, false, 0},
+        {"seeks",       256, 256,       97,  97,  0,  0,    1000, true,  0,   false, false, 0,   0,  0,  false, false, 0},
+        {"long gates",  256, 256,       120, 120, 0,  0,    1000, true,  250, false, false, 0,   0,  0,  false, false, 0},
+        {"patches",     256, 256,       120, 120, 0,  0,    1000, true,  0,   true,  false, 0,   0,  0,  false, false, 0},
+        {"own clock",   256, 256,       60,  180, 30, 0,    0,    true,  0,   false, true,  0,   0,  0,  false, false, 0},
+        {"edits",       256, 256,       120, 120, 0,  0,    0,    true,  0,   false, false, 5.3, 0,  0,  false, false, 0},
+        {"swing",       256, 256,       120, 120, 0,  0,    0,    true,  0,   false, false, 0,   30, 20, false, false, 0},
+        {"lanes",       256, 256,       120, 120, 0,  0,    1000, true,  0,   false, false, 0,   0,  0,  true,  false, 0},
+        {"combinations", 256, 256,      120, 120, 0,  0,    1000, true,  0,   true,  false, 0,   0,  0,  false, true, 0},
+        {"stops",       256, 256,       120, 120, 0,  0,    0,    false, 1600, false, false, 0,  0,  0,  false, false, 500},
+};
+
+// The accents, probabilities and levels that the "lanes" scenario gives the first generators. The only probability
+// used is 2 (played one time in two), so that the onsets played can be told from those left out.
+static const char *const scenario_lanes[][N_LANES] = {
+        {"x..x..x.", NULL,               "0123"},
+        {"x",        "2...2...",         "3...1"},
+        {NULL,       "..2.2.....2.2..2", "x.x.x.x.x.x.x.x."},
+};
+
+// The generators that the "combinations" scenario has play a combination of the patterns of two generators (itself
+// included) instead of a pattern of their own
+static const struct {
+    unsigned short generator;
+    unsigned combination;
+    unsigned short first;
+    unsigned short second;
+} scenario_combinations[] = {
+        {7, COMBINE_AND_NOT, 1, 2},
+        {4, COMBINE_XOR,     0, 3},
+        {5, COMBINE_AND,     6, 7},
+        {3, COMBINE_OR,      3, 6},
+};
+
+static Test_host host;
+static char bundle_path[4096]; // the directory the plugin was loaded from, as hosts tell it
+static uint64_t random_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t next_random(void) {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return random_state;
+}
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+static void add_telemetry(const LV2_Atom_Sequence *notify, Telemetry *telemetry) {
+    const LV2_URID type = host_map_uri(&host, EUCLIDEAN__Telemetry);
+    LV2_ATOM_SEQUENCE_FOREACH(notify, event) {
+        const LV2_Atom_Object *object = (const LV2_Atom_Object *) &event->body;
+        if (object->body.otype != type) {
+            continue;
+        }
+        const LV2_Atom_Long *dropped_events = NULL, *late_onsets = NULL, *missed_onsets = NULL;
+        lv2_atom_object_get(object,
+                            host_map_uri(&host, EUCLIDEAN__droppedEvents), &dropped_events,
+                            host_map_uri(&host, EUCLIDEAN__lateOnsets), &late_onsets,
+                            host_map_uri(&host, EUCLIDEAN__missedOnsets), &missed_onsets,
+                            0);
+        telemetry->dropped_events += dropped_events != NULL ? dropped_events->body : 0;
+        telemetry->late_onsets += late_onsets != NULL ? late_onsets->body : 0;
+        telemetry->missed_onsets += missed_onsets != NULL ? missed_onsets->body : 0;
+    }
+}
+
+// Set every generator up as `generators` says, in a patch:Put, and its note in a patch:Set of its own. The values
+// come in all the types that the plugin takes.
+static void forge_patches(LV2_Atom_Forge *forge) {
+    const LV2_URID patch_Put = host_map_uri(&host, LV2_PATCH__Put);
+    const LV2_URID patch_Set = host_map_uri(&host, LV2_PATCH__Set);
+    const LV2_URID patch_body = host_map_uri(&host, LV2_PATCH__body);
+    const LV2_URID patch_property = host_map_uri(&host, LV2_PATCH__property);
+    const LV2_URID patch_value = host_map_uri(&host, LV2_PATCH__value);
+    const LV2_URID generator_key = host_map_uri(&host, EUCLIDEAN__generator);
+
+    for (unsigned short gen = 0; gen < N_GENERATORS; ++gen) {
+        LV2_Atom_Forge_Frame message_frame, body_frame;
+        lv2_atom_forge_frame_time(forge, 0);
+        lv2_atom_forge_object(forge, &message_frame, 0, patch_Put);
+        lv2_atom_forge_key(forge, generator_key);
+        lv2_atom_forge_int(forge, gen);
+        lv2_atom_forge_key(forge, patch_body);
+        lv2_atom_forge_object(forge, &body_frame, 0, 0);
+        lv2_atom_forge_key(forge, host_map_uri(&host, EUCLIDEAN__enabled));
+        lv2_atom_forge_bool(forge, true);
+        lv2_atom_forge_key(forge, host_map_uri(&host, EUCLIDEAN__beats));
+        lv2_atom_forge_int(forge, generators[gen].beats);
+        lv2_atom_forge_key(forge, host_map_uri(&host, EUCLIDEAN__onsets));
+        lv2_atom_forge_long(forge, generators[gen].onsets);
+        lv2_atom_forge_key(forge, host_map_uri(&host, EUCLIDEAN__rotation));
+        lv2_atom_forge_float(forge, generators[gen].rotation);
+        lv2_atom_forge_key(forge, host_map_uri(&host, EUCLIDEAN__bars));
+        lv2_atom_forge_double(forge, generators[gen].size_in_bars);
+        lv2_atom_forge_key(forge, host_map_uri(&host, EUCLIDEAN__velocity));
+        lv2_atom_forge_int(forge, 100);
+        lv2_atom_forge_pop(forge, &body_frame);
+        lv2_atom_forge_pop(forge, &message_frame);
+
+        lv2_atom_forge_frame_time(forge, 0);
+        lv2_atom_forge_object(forge, &message_frame, 0, patch_Set);
+        lv2_atom_forge_key(forge, generator_key);
+        lv2_atom_forge_int(forge, gen);
+        lv2_atom_forge_key(forge, patch_property);
+        lv2_atom_forge_urid(forge, host_map_uri(&host, EUCLIDEAN__note));
+        lv2_atom_forge_key(forge, patch_value);
+        lv2_atom_forge_int(forge, FIRST_NOTE + gen);
+        lv2_atom_forge_pop(forge, &message_frame);
+    }
+}
+
+// Give the generators their lanes, one patch:Set each
+static void forge_lanes(LV2_Atom_Forge *forge) {
+    const LV2_URID patch_Set = host_map_uri(&host, LV2_PATCH__Set);
+    const LV2_URID patch_property = host_map_uri(&host, LV2_PATCH__property);
+    const LV2_URID patch_value = host_map_uri(&host, LV2_PATCH__value);
+    const char *const uris[N_LANES] = {EUCLIDEAN__accent, EUCLIDEAN__probability, EUCLIDEAN__level};
+
+    for (unsigned short gen = 0; gen < N_GENERATORS; ++gen) {
+        for (unsigned lane = 0; lane < N_LANES; ++lane) {
+            if (generators[gen].lanes[lane] == NULL) {
+                continue;
+            }
+            LV2_Atom_Forge_Frame message_frame;
+            lv2_atom_forge_frame_time(forge, 0);
+            lv2_atom_forge_object(forge, &message_frame, 0, patch_Set);
+            lv2_atom_forge_key(forge, host_map_uri(&host, EUCLIDEAN__generator));
+            lv2_atom_forge_int(forge, gen);
+            lv2_atom_forge_key(forge, patch_property);
+            lv2_atom_forge_urid(forge, host_map_uri(&host, uris[lane]));
+            lv2_atom_forge_key(forge, patch_value);
+            lv2_atom_forge_string(forge, generators[gen].lanes[lane], (uint32_t) strlen(generators[gen].lanes[lane]));
+            lv2_atom_forge_pop(forge, &message_frame);
+        }
+    }
+}
+
+// Have some generators combine the patterns of others, a patch:Put each
+static void forge_combinations(LV2_Atom_Forge *forge) {
+    const LV2_URID patch_Put = host_map_uri(&host, LV2_PATCH__Put);
+    const LV2_URID patch_body = host_map_uri(&host, LV2_PATCH__body);
+
+    for (size_t i = 0; i < sizeof(scenario_combinations) / sizeof(scenario_combinations[0]); ++i) {
+        LV2_Atom_Forge_Frame message_frame, body_frame;
+        lv2_atom_forge_frame_time(forge, 0);
+        lv2_atom_forge_object(forge, &message_frame, 0, patch_Put);
+        lv2_atom_forge_key(forge, host_map_uri(&host, EUCLIDEAN__generator));
+        lv2_atom_forge_int(forge, scenario_combinations[i].generator);
+        lv2_atom_forge_key(forge, patch_body);
+        lv2_atom_forge_object(forge, &body_frame, 0, 0);
+        lv2_atom_forge_key(forge, host_map_uri(&host, EUCLIDEAN__combination));
+        lv2_atom_forge_int(forge, (int32_t) scenario_combinations[i].combination);
+        lv2_atom_forge_key(forge, host_map_uri(&host, EUCLIDEAN__first));
+        lv2_atom_forge_int(forge, scenario_combinations[i].first);
+        lv2_atom_forge_key(forge, host_map_uri(&host, EUCLIDEAN__second));
+        lv2_atom_forge_int(forge, scenario_combinations[i].second);
+        lv2_atom_forge_pop(forge, &body_frame);
+        lv2_atom_forge_pop(forge, &message_frame);
+    }
+}
+
+// The pattern that a generator plays when it combines the Euclidean patterns of two others, worked out a beat at a
+// time: those are cut to its beats (or padded with silence), combined, and rotated as it is
+static void combine(const Generator *generator, unsigned combination, const Generator *first, const Generator *second,
+                    pattern *p) {
+    pattern a, b;
+    pattern_euclidean(&a, first->onsets, first->beats, first->rotation);
+    pattern_euclidean(&b, second->onsets, second->beats, second->rotation);
+    memset(p, 0, sizeof(pattern));
+    for (unsigned short step = 0; step < generator->beats; ++step) {
+        const short beats = (short) generator->beats;
+        const unsigned short beat = (unsigned short) ((step + generator->rotation % beats + beats) % beats);
+        const bool x = beat < first->beats && pattern_test(&a, beat);
+        const bool y = beat < second->beats && pattern_test(&b, beat);
+        if (combination == COMBINE_AND ? x && y : combination == COMBINE_OR ? x || y :
+            combination == COMBINE_XOR ? x != y : x && !y) {
+            pattern_set(p, step);
+        }
+    }
+}
+
+// What a lane says about a step, read as the plugin reads it
+static unsigned lane_value(const char *lane, long step) {
+    if (lane == NULL || step >= (long) strlen(lane)) {
+        return 0;
+    }
+    return lane[step] >= '0' && lane[step] <= '3' ? (unsigned) (lane[step] - '0') : lane[step] == 'x';
+}
+
+// The velocity a generator plays a step at, with its lanes
+static int lane_velocity(const Generator *generator, long step, int velocity) {
+    const int value = velocity * (4 - (int) lane_value(generator->lanes[LEVEL_LANE], step)) / 4 +
+                      (lane_value(generator->lanes[ACCENT_LANE], step) ? ACCENT_VELOCITY : 0);
+    return value < 1 ? 1 : value > 127 ? 127 : value;
+}
+
+// Take an onset off every generator, from where the transport is (at `beat`) on. The edited patterns take over at
+// the start of the next repetition of the patterns being played.
+static void forge_edits(LV2_Atom_Forge *forge, double beat) {
+    const LV2_URID patch_Set = host_map_uri(&host, LV2_PATCH__Set);
+    const LV2_URID patch_property = host_map_uri(&host, LV2_PATCH__property);
+    const LV2_URID patch_value = host_map_uri(&host, LV2_PATCH__value);
+
+    for (unsigned short gen = 0; gen < N_GENERATORS; ++gen) {
+        LV2_Atom_Forge_Frame message_frame;
+        lv2_atom_forge_frame_time(forge, 0);
+        lv2_atom_forge_object(forge, &message_frame, 0, patch_Set);
+        lv2_atom_forge_key(forge, host_map_uri(&host, EUCLIDEAN__generator));
+        lv2_atom_forge_int(forge, gen);
+        lv2_atom_forge_key(forge, patch_property);
+        lv2_atom_forge_urid(forge, host_map_uri(&host, EUCLIDEAN__onsets));
+        lv2_atom_forge_key(forge, patch_value);
+        lv2_atom_forge_int(forge, generators[gen].onsets - 1);
+        lv2_atom_forge_pop(forge, &message_frame);
+
+        const double pattern_beats = (double) generators[gen].size_in_bars * BEATS_PER_BAR;
+        generators[gen].swap_beat = ceil(beat / pattern_beats) * pattern_beats;
+    }
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    const double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+// How many onsets of a pattern of a generator the timeline has before `beat`: those always played, or (`chance`)
+// those that the probability lane may leave out
+static long pattern_onsets_before(const Generator *generator, const pattern *p, double beat, bool chance) {
+    const double pattern_beats = (double) generator->size_in_bars * BEATS_PER_BAR;
+    const double step_length = pattern_beats / generator->beats;
+    const double repetitions = floor(beat / pattern_beats);
+    const double rest = beat - repetitions * pattern_beats;
+
+    long per_repetition = 0, onsets = 0;
+    for (unsigned short step = 0; step < generator->beats; ++step) {
+        const bool counted = pattern_test(p, step) && (lane_value(generator->lanes[PROBABILITY_LANE], step) != 0) == chance;
+        per_repetition += counted;
+        onsets += counted && (step + (step & 1) * generator->swing) * step_length < rest;
+    }
+    return (long) repetitions * per_repetition + onsets;
+}
+
+// ...and of the generator, whichever of its patterns it plays
+static long onsets_before(const Generator *generator, double beat, bool chance) {
+    if (beat <= generator->swap_beat) {
+        return pattern_onsets_before(generator, &generator->pattern, beat, chance);
+    }
+    return pattern_onsets_before(generator, &generator->pattern, generator->swap_beat, chance) +
+           pattern_onsets_before(generator, &generator->edited, beat, chance) -
+           pattern_onsets_before(generator, &generator->edited, generator->swap_beat, chance);
+}
+
+// The plugin plays, from the start of a segment to its end, the onsets whose frames (once rounded) fall in it
+static long onsets_between(const Segment *start, double end_beat, double end_half_frame, bool chance) {
+    long onsets = 0;
+    for (unsigned short gen = 0; gen < N_GENERATORS; ++gen) {
+        onsets += onsets_before(&generators[gen], end_beat - end_half_frame, chance) -
+                  onsets_before(&generators[gen], start->beat - start->half_frame, chance);
+    }
+    return onsets;
+}
+
+static float tempo_at(const Scenario *scenario, double seconds) {
+    if (scenario->sweep_seconds <= 0) {
+        return scenario->min_bpm;
+    }
+    const double phase = fmod(seconds / scenario->sweep_seconds, 1.0);
+    const double triangle = phase < 0.5 ? 2 * phase : 2 - 2 * phase;
+    return (float) (scenario->min_bpm + (scenario->max_bpm - scenario->min_bpm) * triangle);
+}
+
+static bool play(const LV2_Descriptor *descriptor, const Scenario *scenario, bool worker, long n_blocks,
+                 double *costs, bool first) {
+    static uint8_t control[CONTROL_CAPACITY] __attribute__((aligned(8)));
+    static uint8_t midi_out[MIDI_OUT_CAPACITY] __attribute__((aligned(8)));
+    static uint8_t notify[NOTIFY_CAPACITY] __attribute__((aligned(8)));
+    float ports[N_GENERATORS][N_PARAMETERS];
+    float gates[N_GENERATORS];
+    float grooves[N_GENERATORS][3];
+    float clock = scenario->internal_clock, tempo = tempo_at(scenario, 0);
+
+    LV2_Handle instance = descriptor->instantiate(descriptor, SAMPLE_RATE, bundle_path,
+                                                  worker ? host.worker_features : host.features);
+    const LV2_Worker_Interface *worker_interface =
+            worker ? (const LV2_Worker_Interface *) descriptor->extension_data(LV2_WORKER__interface) : NULL;
+    for (unsigned short gen = 0; gen < N_GENERATORS; ++gen) {
+        Generator *generator = &generators[gen];
+        pattern_euclidean(&generator->pattern, generator->onsets, generator->beats, generator->rotation);
+        pattern_euclidean(&generator->edited, generator->onsets - 1, generator->beats, generator->rotation);
+    }
+    const size_t n_combinations =
+            scenario->combinations ? sizeof(scenario_combinations) / sizeof(scenario_combinations[0]) : 0;
+    for (size_t i = 0; i < n_combinations; ++i) {
+        Generator *generator = &generators[scenario_combinations[i].generator];
+        combine(generator, scenario_combinations[i].combination, &generators[scenario_combinations[i].first],
+                &generators[scenario_combinations[i].second], &generator->pattern);
+        generator->edited = generator->pattern;
+    }
+    for (unsigned short gen = 0; gen < N_GENERATORS; ++gen) {
+        generators[gen].swap_beat = INFINITY;
+        generators[gen].swing = scenario->swing / 100.0;
+        for (unsigned lane = 0; lane < N_LANES; ++lane) {
+            generators[gen].lanes[lane] = scenario->lanes && gen < sizeof(scenario_lanes) / sizeof(scenario_lanes[0])
+                                          ? scenario_lanes[gen][lane] : NULL;
+        }
+    }
+    descriptor->connect_port(instance, CONTROL_PORT, control);
+    descriptor->connect_port(instance, MIDI_OUT_PORT, midi_out);
+    descriptor->connect_port(instance, NOTIFY_PORT, notify);
+    for (unsigned short gen = 0; gen < N_GENERATORS; ++gen) {
+        ports[gen][ENABLED_IDX] = 1;
+        ports[gen][BEATS_IDX] = generators[gen].beats;
+        ports[gen][ONSETS_IDX] = generators[gen].onsets;
+        ports[gen][ROTATION_IDX] = generators[gen].rotation;
+        ports[gen][BARS_IDX] = generators[gen].size_in_bars;
+        ports[gen][CHANNEL_IDX] = 10;
+        ports[gen][NOTE_IDX] = FIRST_NOTE + gen;
+        ports[gen][VELOCITY_IDX] = 100;
+        if (scenario->patches) {
+            // nothing to play through the ports, it's all in the patch messages
+            ports[gen][ENABLED_IDX] = 0;
+            ports[gen][ONSETS_IDX] = 0;
+            ports[gen][NOTE_IDX] = 0;
+        }
+        for (unsigned short parameter = 0; parameter < N_PARAMETERS; ++parameter) {
+            descriptor->connect_port(instance, 2 + gen * N_PARAMETERS + parameter, &ports[gen][parameter]);
+        }
+        gates[gen] = scenario->gate;
+        descriptor->connect_port(instance, GATE_PORT(gen), &gates[gen]);
+        grooves[gen][0] = scenario->swing;
+        grooves[gen][1] = 0;
+        grooves[gen][2] = scenario->dynamics;
+        descriptor->connect_port(instance, SWING_PORT(gen), &grooves[gen][0]);
+        descriptor->connect_port(instance, TIMING_PORT(gen), &grooves[gen][1]);
+        descriptor->connect_port(instance, DYNAMICS_PORT(gen), &grooves[gen][2]);
+    }
+    descriptor->connect_port(instance, CLOCK_PORT, &clock);
+    descriptor->connect_port(instance, TEMPO_PORT, &tempo);
+    descriptor->activate(instance);
+
+    LV2_Atom_Forge forge;
+    lv2_atom_forge_init(&forge, &host.map);
+
+    int64_t frame = 0;
+    double beat = 0, seconds = 0;
+    float bpm = tempo_at(scenario, 0);
+    Segment segment = {0, 0.5 * bpm / 60 / SAMPLE_RATE};
+    bool moved = true, stopped = false;
+    long frames = 0, notes = 0, expected_notes = 0, misplaced_notes = 0, unbalanced_notes = 0;
+    long chance_notes = 0, chance_onsets = 0, hanging_notes = 0;
+    bool sounding[128] = {false};
+    double max_error = 0;
+    Telemetry telemetry = {0, 0, 0};
+
+    for (long block = 0; block < n_blocks; ++block) {
+        uint32_t n_samples = scenario->min_block;
+        if (scenario->max_block > scenario->min_block) {
+            n_samples += next_random() % (scenario->max_block - scenario->min_block + 1);
+        }
+
+        const float previous_bpm = bpm;
+        bpm = tempo_at(scenario, seconds);
+        const double beats_per_frame = bpm / 60.0 / SAMPLE_RATE;
+
+        // A loop ends where the block does
+        if (scenario->loop_beats > 0) {
+            const double frames_to_end = ceil((scenario->loop_beats - beat) / beats_per_frame);
+            if (frames_to_end < n_samples) {
+                n_samples = frames_to_end < 1 ? 1 : (uint32_t) frames_to_end;
+            }
+        }
+
+        // The transport stops, and starts again, right where it was
+        const bool was_stopped = stopped;
+        stopped = scenario->stop_period > 0 && block / scenario->stop_period % 2 == 1;
+
+        LV2_Atom_Forge_Frame sequence_frame;
+        lv2_atom_forge_set_buffer(&forge, control, sizeof(control));
+        lv2_atom_forge_sequence_head(&forge, &sequence_frame, 0);
+        if (scenario->internal_clock) {
+            // a transport that stands still somewhere else, which the plugin has to ignore
+            tempo = bpm;
+            host_forge_position(&host, &forge, 0, 12345, 0, 90, 3, 7);
+        } else if (moved || bpm != previous_bpm || stopped != was_stopped || scenario->position_every_block) {
+            host_forge_position(&host, &forge, 0, frame, stopped ? 0 : 1, bpm, BEATS_PER_BAR, beat);
+        }
+        if (scenario->patches && block == 0) {
+            forge_patches(&forge);
+        }
+        if (scenario->lanes && block == 0) {
+            forge_lanes(&forge);
+        }
+        if (scenario->combinations && block == 0) {
+            forge_combinations(&forge);
+        }
+        if (scenario->edit_beat > 0 && beat >= scenario->edit_beat && generators[0].swap_beat == INFINITY) {
+            forge_edits(&forge, beat);
+        }
+        lv2_atom_forge_pop(&forge, &sequence_frame);
+        moved = false;
+
+        ((LV2_Atom *) midi_out)->size = MIDI_OUT_CAPACITY - sizeof(LV2_Atom);
+        ((LV2_Atom *) notify)->size = NOTIFY_CAPACITY - sizeof(LV2_Atom);
+        const double start = now();
+        descriptor->run(instance, n_samples);
+        costs[block] = now() - start;
+        if (worker_interface != NULL) {
+            host_run_worker(&host, worker_interface, instance);
+        }
+
+        add_telemetry((const LV2_Atom_Sequence *) notify, &telemetry);
+        int64_t previous_frames = 0;
+        LV2_ATOM_SEQUENCE_FOREACH((const LV2_Atom_Sequence *) midi_out, event) {
+            const uint8_t *const msg = (const uint8_t *) (event + 1);
+
+            // Events in time order, and every note switched off before it is played again
+            const bool note_on = (msg[0] & 0xF0) == 0x90 && msg[2] != 0;
+            unbalanced_notes += event->time.frames < previous_frames || sounding[msg[1] & 0x7F] == note_on;
+            sounding[msg[1] & 0x7F] = note_on;
+            previous_frames = event->time.frames;
+            if (!note_on) {
+                continue;
+            }
+            if (msg[1] < FIRST_NOTE || msg[1] >= FIRST_NOTE + N_GENERATORS) {
+                ++misplaced_notes;
+                continue;
+            }
+            const Generator *generator = &generators[msg[1] - FIRST_NOTE];
+            const double pattern_beats = (double) generator->size_in_bars * BEATS_PER_BAR;
+            const double step_length = pattern_beats / generator->beats;
+            const double note_beat = beat + event->time.frames * beats_per_frame;
+            const pattern *played = note_beat >= generator->swap_beat - beats_per_frame ? &generator->edited
+                                                                                       : &generator->pattern;
+            const double position = fmod(note_beat, pattern_beats);
+            const long step = lround(position / step_length);
+            const double swing = (step % generator->beats & 1) * generator->swing;
+            const double error = fabs(position - (step + swing) * step_length) / beats_per_frame;
+
+            if (lane_value(generator->lanes[PROBABILITY_LANE], step % generator->beats) != 0) {
+                ++chance_notes;
+            } else {
+                ++notes;
+            }
+            max_error = error > max_error ? error : max_error;
+            misplaced_notes += !pattern_test(played, step % generator->beats) ||
+                               abs(msg[2] - lane_velocity(generator, step % generator->beats,
+                                                          (int) ports[0][VELOCITY_IDX])) > scenario->dynamics;
+        }
+
+        // nothing may go on sounding while the transport stands still
+        frames += n_samples;
+        if (stopped) {
+            for (unsigned short note = 0; note < 128; ++note) {
+                hanging_notes += sounding[note];
+            }
+            continue;
+        }
+        frame += n_samples;
+        beat += n_samples * beats_per_frame;
+        seconds += (double) n_samples / SAMPLE_RATE;
+
+        const bool loop_ended = scenario->loop_beats > 0 && beat >= scenario->loop_beats;
+        const bool seek = scenario->seek_period > 0 && next_random() % scenario->seek_period == 0;
+        if (loop_ended || seek) {
+            expected_notes += onsets_between(&segment, beat, 0.5 * beats_per_frame, false);
+            chance_onsets += onsets_between(&segment, beat, 0.5 * beats_per_frame, true);
+            frame = loop_ended ? 0 : (int64_t) (next_random() % SEEK_RANGE);
+            beat = frame * beats_per_frame;
+            segment.beat = beat;
+            segment.half_frame = 0.5 * beats_per_frame;
+            moved = true;
+        }
+    }
+    expected_notes += onsets_between(&segment, beat, 0.5 * bpm / 60 / SAMPLE_RATE, false);
+    chance_onsets += onsets_between(&segment, beat, 0.5 * bpm / 60 / SAMPLE_RATE, true);
+
+    descriptor->deactivate(instance);
+    descriptor->cleanup(instance);
+
+    double total = 0, squares = 0;
+    for (long block = 0; block < n_blocks; ++block) {
+        total += costs[block];
+        squares += costs[block] * costs[block];
+    }
+    const double mean = total / n_blocks;
+    const double jitter = sqrt(fmax(0, squares / n_blocks - mean * mean));
+    qsort(costs, n_blocks, sizeof(double), compare_doubles);
+
+    printf("%s\n  {\"name\": \"%s\", \"worker\": %s, \"blocks\": %ld, \"frames\": %ld, \"mean_ns\": %.1f, \"p50_ns\": %.1f, "
+           "\"p99_ns\": %.1f, \"max_ns\": %.1f, \"jitter_ns\": %.1f, \"notes\": %ld, \"expected_notes\": %ld, "
+           "\"chance_notes\": %ld, \"chance_onsets\": %ld, \"misplaced_notes\": %ld, \"unbalanced_notes\": %ld, "
+           "\"max_offset_error_frames\": %.3f, \"dropped_events\": %ld, \"late_onsets\": %ld, \"missed_onsets\": %ld, "
+           "\"hanging_notes\": %ld}",
+           first ? "{\"scenarios\": [" : ",", scenario->name, worker ? "true" : "false", n_blocks, frames, mean, costs[n_blocks / 2],
+           costs[n_blocks - 1 - n_blocks / 100], costs[n_blocks - 1], jitter, notes, expected_notes,
+           chance_notes, chance_onsets, misplaced_notes, unbalanced_notes, max_error, telemetry.dropped_events, telemetry.late_onsets,
+           telemetry.missed_onsets, hanging_notes);
+
+    // about one in two of the onsets left to chance are played (within four standard deviations)
+    return misplaced_notes == 0 && unbalanced_notes == 0 && hanging_notes == 0 && notes == expected_notes &&
+           labs(2 * chance_notes - chance_onsets) <= 4 * sqrt((double) chance_onsets) &&
+           max_error <= OFFSET_TOLERANCE && telemetry.dropped_events == 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "Usage: %s PLUGIN [BLOCKS]\n"
+                        "Play the plugin (e.g. euclidean.so) through each scenario for BLOCKS blocks (by default %d)\n",
+                argv[0], DEFAULT_BLOCKS);
+        return 2;
+    }
+    const long n_blocks = argc == 3 ? atol(argv[2]) : DEFAULT_BLOCKS;
+    if (n_blocks < 1) {
+        fprintf(stderr, "The number of blocks must be positive\n");
+        return 2;
+    }
+
+    void *library = dlopen(argv[1], RTLD_NOW);
+    if (library == NULL) {
+        fprintf(stderr, "Could not load %s: %s\n", argv[1], dlerror());
+        return 2;
+    }
+    const LV2_Descriptor *(*lv2_descriptor)(uint32_t) =
+            (const LV2_Descriptor *(*)(uint32_t)) dlsym(library, "lv2_descriptor");
+    const LV2_Descriptor *descriptor = lv2_descriptor == NULL ? NULL : lv2_descriptor(0);
+    if (descriptor == NULL || strcmp(descriptor->URI, EUCLIDEAN_URI) != 0) {
+        fprintf(stderr, "%s is not the plugin with %d generators\n", argv[1], N_GENERATORS);
+        return 2;
+    }
+
+    const char *slash = strrchr(argv[1], '/');
+    const size_t length = slash == NULL ? 0 : (size_t) (slash - argv[1]) + 1;
+    if (length >= sizeof(bundle_path)) {
+        fprintf(stderr, "%s is too long a path\n", argv[1]);
+        return 2;
+    }
+    memcpy(bundle_path, argv[1], length);
+    strcpy(bundle_path + length, length == 0 ? "./" : "");
+
+    host_init(&host);
+
+    double *costs = malloc(n_blocks * sizeof(double));
+    bool passed = true;
+    for (int worker = 0; worker < 2; ++worker) {
+        for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); ++i) {
+            passed &= play(descriptor, &scenarios[i], worker, n_blocks, costs, !worker && i == 0);
+        }
+    }
+    printf("\n]}\n");
+
+    free(costs);
+    host_free(&host);
+    dlclose(library);
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,202 @@
+/*
+ * Copyright 2023, 2024 by Bruno Unna.
+ *
+ * This file is part of Euclidean Rhythms.
+ *
+ * Euclidean Rhythms is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * Euclidean Rhythms is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with Euclidean Rhythms.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef LV2_HOST_H
+#define LV2_HOST_H
+
+// The little of a host that the benchmarks need: a URID map, a log that discards everything, a worker (for those
+// that want one), and a way of telling the plugin where the transport is
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <lv2/lv2plug.in/ns/ext/atom/forge.h>
+#include <lv2/lv2plug.in/ns/ext/log/log.h>
+#include <lv2/lv2plug.in/ns/ext/time/time.h>
+#include <lv2/lv2plug.in/ns/ext/urid/urid.h>
+#include <lv2/lv2plug.in/ns/ext/worker/worker.h>
+
+#define HOST_MAX_URIS 64
+#define HOST_WORK_CAPACITY 65536
+
+// Messages between the plugin and its worker, each its size followed by its body (padded to 8 bytes)
+typedef struct {
+    uint8_t buffer[HOST_WORK_CAPACITY] __attribute__((aligned(8)));
+    uint32_t used;
+} Host_messages;
+
+typedef struct {
+    char *uris[HOST_MAX_URIS];
+    uint32_t n_uris;
+    LV2_URID_Map map;
+    LV2_Log_Log log;
+    LV2_Feature map_feature;
+    LV2_Feature log_feature;
+    const LV2_Feature *features[3];
+
+    // The work the plugin schedules is done once run() returns, in the same thread, and the responses are delivered
+    // right after, as a host's worker thread that is never late would do
+    LV2_Worker_Schedule schedule;
+    LV2_Feature schedule_feature;
+    const LV2_Feature *worker_features[4];  // `features`, and the worker
+    Host_messages requests;
+    Host_messages responses;
+    long works;                             // requests worked on
+
+    LV2_URID time_Position;
+    LV2_URID time_frame;
+    LV2_URID time_speed;
+    LV2_URID time_beats_per_minute;
+    LV2_URID time_beats_per_bar;
+    LV2_URID time_bar;
+    LV2_URID time_bar_beat;
+} Test_host;
+
+static inline LV2_URID host_map_uri(LV2_URID_Map_Handle handle, const char *uri) {
+    Test_host *host = (Test_host *) handle;
+    for (uint32_t i = 0; i < host->n_uris; ++i) {
+        if (!strcmp(host->uris[i], uri)) {
+            return i + 1;
+        }
+    }
+    if (host->n_uris == HOST_MAX_URIS) {
+        return 0;
+    }
+    host->uris[host->n_uris] = strcpy(malloc(strlen(uri) + 1), uri);
+    return ++host->n_uris;
+}
+
+// The plugin traces what it does, which is of no interest here
+static inline int host_vprintf_log(LV2_Log_Handle handle, LV2_URID type, const char *fmt, va_list ap) {
+    (void) handle, (void) type, (void) fmt, (void) ap;
+    return 0;
+}
+
+static inline int host_printf_log(LV2_Log_Handle handle, LV2_URID type, const char *fmt, ...) {
+    (void) handle, (void) type, (void) fmt;
+    return 0;
+}
+
+static inline LV2_Worker_Status host_queue_message(Host_messages *messages, uint32_t size, const void *data) {
+    const uint32_t padded = (uint32_t) sizeof(uint32_t) + ((size + 7) & ~7u);
+    if (HOST_WORK_CAPACITY - messages->used < padded + (uint32_t) sizeof(uint32_t)) {
+        return LV2_WORKER_ERR_NO_SPACE;
+    }
+    memcpy(messages->buffer + messages->used, &size, sizeof(size));
+    memcpy(messages->buffer + messages->used + sizeof(size), data, size);
+    messages->used += padded;
+    return LV2_WORKER_SUCCESS;
+}
+
+static inline LV2_Worker_Status host_schedule_work(LV2_Worker_Schedule_Handle handle, uint32_t size,
+                                                   const void *data) {
+    return host_queue_message(&((Test_host *) handle)->requests, size, data);
+}
+
+static inline LV2_Worker_Status host_respond(LV2_Worker_Respond_Handle handle, uint32_t size, const void *data) {
+    return host_queue_message(&((Test_host *) handle)->responses, size, data);
+}
+
+// The host points at itself, so it must stay where it is initialised
+static inline void host_init(Test_host *host) {
+    memset(host, 0, sizeof(Test_host));
+    host->map.handle = host;
+    host->map.map = host_map_uri;
+    host->log.printf = host_printf_log;
+    host->log.vprintf = host_vprintf_log;
+    host->map_feature.URI = LV2_URID__map;
+    host->map_feature.data = &host->map;
+    host->log_feature.URI = LV2_LOG__log;
+    host->log_feature.data = &host->log;
+    host->features[0] = &host->map_feature;
+    host->features[1] = &host->log_feature;
+    host->features[2] = NULL;
+    host->schedule.handle = host;
+    host->schedule.schedule_work = host_schedule_work;
+    host->schedule_feature.URI = LV2_WORKER__schedule;
+    host->schedule_feature.data = &host->schedule;
+    host->worker_features[0] = &host->map_feature;
+    host->worker_features[1] = &host->log_feature;
+    host->worker_features[2] = &host->schedule_feature;
+    host->worker_features[3] = NULL;
+
+    host->time_Position = host_map_uri(host, LV2_TIME__Position);
+    host->time_frame = host_map_uri(host, LV2_TIME__frame);
+    host->time_speed = host_map_uri(host, LV2_TIME__speed);
+    host->time_beats_per_minute = host_map_uri(host, LV2_TIME__beatsPerMinute);
+    host->time_beats_per_bar = host_map_uri(host, LV2_TIME__beatsPerBar);
+    host->time_bar = host_map_uri(host, LV2_TIME__bar);
+    host->time_bar_beat = host_map_uri(host, LV2_TIME__barBeat);
+}
+
+// What a host does between two calls to run() of an instance given `host->worker_features`: do the work it
+// scheduled, hand it the responses, and tell it that they are all there
+static inline void host_run_worker(Test_host *host, const LV2_Worker_Interface *worker, LV2_Handle instance) {
+    static Host_messages requests;
+    requests = host->requests;
+    host->requests.used = 0;
+    for (uint32_t at = 0; at < requests.used;) {
+        uint32_t size;
+        memcpy(&size, requests.buffer + at, sizeof(size));
+        worker->work(instance, host_respond, host, size, requests.buffer + at + sizeof(size));
+        host->works++;
+        at += (uint32_t) sizeof(size) + ((size + 7) & ~7u);
+    }
+    for (uint32_t at = 0; at < host->responses.used;) {
+        uint32_t size;
+        memcpy(&size, host->responses.buffer + at, sizeof(size));
+        worker->work_response(instance, size, host->responses.buffer + at + sizeof(size));
+        at += (uint32_t) sizeof(size) + ((size + 7) & ~7u);
+    }
+    host->responses.used = 0;
+    if (worker->end_run != NULL) {
+        worker->end_run(instance);
+    }
+}
+
+static inline void host_free(Test_host *host) {
+    for (uint32_t i = 0; i < host->n_uris; ++i) {
+        free(host->uris[i]);
+    }
+}
+
+// Add to the sequence being forged a time:Position, at `offset` frames into the block
+static inline void host_forge_position(Test_host *host, LV2_Atom_Forge *forge, uint32_t offset, int64_t frame,
+                                       float speed, float beats_per_minute, float beats_per_bar, double beat) {
+    LV2_Atom_Forge_Frame object_frame;
+    const int64_t bar = (int64_t) (beat / beats_per_bar);
+
+    lv2_atom_forge_frame_time(forge, offset);
+    lv2_atom_forge_object(forge, &object_frame, 0, host->time_Position);
+    lv2_atom_forge_key(forge, host->time_frame);
+    lv2_atom_forge_long(forge, frame);
+    lv2_atom_forge_key(forge, host->time_speed);
+    lv2_atom_forge_float(forge, speed);
+    lv2_atom_forge_key(forge, host->time_beats_per_minute);
+    lv2_atom_forge_float(forge, beats_per_minute);
+    lv2_atom_forge_key(forge, host->time_beats_per_bar);
+    lv2_atom_forge_float(forge, beats_per_bar);
+    lv2_atom_forge_key(forge, host->time_bar);
+    lv2_atom_forge_long(forge, bar);
+    lv2_atom_forge_key(forge, host->time_bar_beat);
+    lv2_atom_forge_float(forge, (float) (beat - (double) bar * beats_per_bar));
+    lv2_atom_forge_pop(forge, &object_frame);
+}
+
+#endif //LV2_HOST_H
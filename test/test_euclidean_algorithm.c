@@ -16,7 +16,10 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 #include "../include/euclidean.h"
+#include "../include/pattern_cache.h"
+#include "../include/pattern_db.h"
 
 int main() {
     unsigned long r;
@@ -111,5 +114,107 @@ int main() {
         return 1;
     }
 
+    printf("Testing e(onsets: 3, beats: 8, rotation: 9)\n");
+    r = e(3, 8, 9);
+    if (r == 0b00100101) {
+        printf("Received the expected result (..x..x.x)\n");
+    } else {
+        printf("Received a wrong result (0x%lx), expecting 0x%lx\n", r, 0b00100101L);
+        return 1;
+    }
+
+    printf("Testing e(onsets: 2, beats: 40, rotation: 0)\n");
+    r = e(2, 40, 0);
+    if (r == 0x8000080000L) {
+        printf("Received the expected result (x...................x...................)\n");
+    } else {
+        printf("Received a wrong result (0x%lx), expecting 0x%lx\n", r, 0x8000080000L);
+        return 1;
+    }
+
+    printf("Testing e(onsets: 1, beats: 64, rotation: -1)\n");
+    r = e(1, 64, -1);
+    if (r == 0x4000000000000000L) {
+        printf("Received the expected result (.x..............................................................)\n");
+    } else {
+        printf("Received a wrong result (0x%lx), expecting 0x%lx\n", r, 0x4000000000000000L);
+        return 1;
+    }
+
+    pattern p;
+
+    printf("Testing pattern_euclidean(onsets: 2, beats: 128, rotation: 0)\n");
+    pattern_euclidean(&p, 2, 128, 0);
+    if (p.w[0] == 0x8000000000000000L && p.w[1] == 0x8000000000000000L && p.w[2] == 0) {
+        printf("Received the expected result (onsets at beats 0 and 64)\n");
+    } else {
+        printf("Received a wrong result (0x%lx 0x%lx), expecting 0x%lx 0x%lx\n",
+               p.w[0], p.w[1], 0x8000000000000000L, 0x8000000000000000L);
+        return 1;
+    }
+
+    printf("Testing pattern_euclidean(onsets: 1, beats: 100, rotation: -70)\n");
+    pattern_euclidean(&p, 1, 100, -70);
+    if (p.w[0] == 0 && p.w[1] == 0x0200000000000000L && pattern_next(&p, 100, 0) == 70) {
+        printf("Received the expected result (single onset at beat 70)\n");
+    } else {
+        printf("Received a wrong result (0x%lx 0x%lx), expecting 0x%lx 0x%lx\n",
+               p.w[0], p.w[1], 0L, 0x0200000000000000L);
+        return 1;
+    }
+
+    printf("Testing pattern_count(pattern_euclidean(onsets: 37, beats: 300, rotation: 11))\n");
+    pattern_euclidean(&p, 37, 300, 11);
+    if (pattern_count(&p) == 37 && pattern_next(&p, 300, 300) == 300) {
+        printf("Received the expected result (37 onsets)\n");
+    } else {
+        printf("Received a wrong result (%d), expecting %d\n", pattern_count(&p), 37);
+        return 1;
+    }
+
+    printf("Testing pattern_cache_acquire(onsets: 3, beats: 8, rotation: 1), twice\n");
+    const Pattern_entry *first = pattern_cache_acquire(3, 8, 1, NULL);
+    const Pattern_entry *second = pattern_cache_acquire(3, 8, 1, NULL);
+    if (first != NULL && first == second && first->references == 2 && first->steps[0] == 2 &&
+        first->steps[1] == 5 && first->steps[2] == 7 && first->steps[3] == NO_ONSET) {
+        printf("Received the expected result (a single entry, onsets at beats 2, 5 and 7)\n");
+    } else {
+        printf("Received a wrong result (%p and %p), expecting the same entry twice\n",
+               (const void *) first, (const void *) second);
+        return 1;
+    }
+    pattern_cache_release(first);
+    pattern_cache_release(second);
+
+    printf("Testing pattern_db_find() against pattern_euclidean(), up to 130 beats\n");
+    Pattern_db db;
+    if (!pattern_db_build(PATTERN_DB_FILE, 130) || !pattern_db_open(&db, ".")) {
+        printf("Could not build and open %s\n", PATTERN_DB_FILE);
+        return 1;
+    }
+    for (unsigned short beats = 1; beats <= 131; ++beats) {
+        for (unsigned short onsets = 0; onsets <= beats + 1; ++onsets) {
+            for (short rotation = -3; rotation <= 3; rotation += 3) {
+                pattern expected;
+                pattern_euclidean(&expected, onsets, beats, rotation);
+                const bool found = pattern_db_find(&db, onsets, beats, rotation, &p);
+                if (found != (beats <= 130) || (found && memcmp(&p, &expected, sizeof(pattern)) != 0)) {
+                    printf("Received a wrong result for E(%d, %d) rotated %d\n", onsets, beats, rotation);
+                    return 1;
+                }
+            }
+        }
+    }
+    const Pattern_db_record *record = pattern_db_record(&db, 6, 8);
+    if (record != NULL && record->period == 4 && record->canonical_rotation == 2 && record->deviation > 0.47f &&
+        record->deviation < 0.48f) {
+        printf("Received the expected result (every pattern, and E(6, 8) repeating every 4 beats)\n");
+    } else {
+        printf("Received a wrong record for E(6, 8)\n");
+        return 1;
+    }
+    pattern_db_close(&db);
+    remove(PATTERN_DB_FILE);
+
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,321 @@
+/*
+ * Copyright 2023, 2024 by Bruno Unna.
+ *
+ * This file is part of Euclidean Rhythms.
+ *
+ * Euclidean Rhythms is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * Euclidean Rhythms is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with Euclidean Rhythms.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Saving and restoring the state of the plugin: what is restored plays as what was saved, snapshots that don't make
+// sense are turned down, and those taken while the plugin runs are never half changed.
+
+#include <pthread.h>
+#include <stdio.h>
+
+// The plugin is included rather than linked, to get at its snapshots
+#include "../src/plugins/plugin_lv2.c"
+#include "lv2_host.h"
+
+#define CONTROL_CAPACITY 4096
+#define MIDI_OUT_CAPACITY 65536
+#define BLOCK_SIZE 256
+#define N_BLOCKS 400
+#define MAX_NOTES 8192
+#define RACE_BLOCKS 200000
+#define RACE_TEMPO 60000    // a bar or more every block, so that patterns are swapped in all the time
+
+typedef struct {
+    LV2_Handle instance;
+    float ports[N_GENERATORS][N_PARAMETERS];
+    uint8_t control[CONTROL_CAPACITY] __attribute__((aligned(8)));
+    uint8_t midi_out[MIDI_OUT_CAPACITY] __attribute__((aligned(8)));
+} Test_plugin;
+
+// A note on or off, where it was played
+typedef struct {
+    long frame;
+    uint8_t message[3];
+} Note;
+
+static Test_host host;
+static const LV2_State_Interface *state_interface;
+
+// The only property the plugin saves, as the host keeps it
+static struct {
+    uint32_t key;
+    uint32_t type;
+    size_t size;
+    uint8_t value[sizeof(Snapshot)] __attribute__((aligned(8)));
+} saved;
+
+static LV2_State_Status store(LV2_State_Handle handle, uint32_t key, const void *value, size_t size, uint32_t type,
+                              uint32_t flags) {
+    (void) handle, (void) flags;
+    if (size > sizeof(saved.value)) {
+        return LV2_STATE_ERR_NO_SPACE;
+    }
+    saved.key = key;
+    saved.type = type;
+    saved.size = size;
+    memcpy(saved.value, value, size);
+    return LV2_STATE_SUCCESS;
+}
+
+static const void *retrieve(LV2_State_Handle handle, uint32_t key, size_t *size, uint32_t *type, uint32_t *flags) {
+    (void) handle;
+    if (key != saved.key) {
+        return NULL;
+    }
+    *size = saved.size;
+    *type = saved.type;
+    *flags = LV2_STATE_IS_POD;
+    return saved.value;
+}
+
+static bool check(bool passed, const char *what) {
+    printf("%s: %s\n", what, passed ? "ok" : "FAILED");
+    return passed;
+}
+
+// An instance whose ports are set as a host restoring a session would set them. Only its first generators play.
+static Test_plugin *start_plugin(void) {
+    Test_plugin *plugin = calloc(1, sizeof(Test_plugin));
+    plugin->instance = descriptor.instantiate(&descriptor, 48000, "", host.features);
+    descriptor.connect_port(plugin->instance, CONTROL_PORT, plugin->control);
+    descriptor.connect_port(plugin->instance, MIDI_OUT_PORT, plugin->midi_out);
+    for (unsigned short gen = 0; gen < N_GENERATORS; ++gen) {
+        float *ports = plugin->ports[gen];
+        ports[ENABLED_IDX] = gen < 4;
+        ports[BEATS_IDX] = 8 + gen;
+        ports[ONSETS_IDX] = gen == 0 ? 10 : 3 + gen;   // more onsets than beats is a beat on every beat
+        ports[ROTATION_IDX] = gen;
+        ports[BARS_IDX] = 1 + gen % 2;
+        ports[CHANNEL_IDX] = 10;
+        ports[NOTE_IDX] = 36 + gen;
+        ports[VELOCITY_IDX] = 100;
+        for (unsigned short parameter = 0; parameter < N_PARAMETERS; ++parameter) {
+            descriptor.connect_port(plugin->instance, 2 + gen * N_PARAMETERS + parameter, &ports[parameter]);
+        }
+    }
+    descriptor.activate(plugin->instance);
+    return plugin;
+}
+
+static void stop_plugin(Test_plugin *plugin) {
+    descriptor.deactivate(plugin->instance);
+    descriptor.cleanup(plugin->instance);
+    free(plugin);
+}
+
+// Set a property of a generator with a patch:Set
+static void forge_property(LV2_Atom_Forge *forge, unsigned short gen, const char *property, int32_t number,
+                           const char *text) {
+    LV2_Atom_Forge_Frame frame;
+    lv2_atom_forge_frame_time(forge, 0);
+    lv2_atom_forge_object(forge, &frame, 0, host_map_uri(&host, LV2_PATCH__Set));
+    lv2_atom_forge_key(forge, host_map_uri(&host, EUCLIDEAN__generator));
+    lv2_atom_forge_int(forge, gen);
+    lv2_atom_forge_key(forge, host_map_uri(&host, LV2_PATCH__property));
+    lv2_atom_forge_urid(forge, host_map_uri(&host, property));
+    lv2_atom_forge_key(forge, host_map_uri(&host, LV2_PATCH__value));
+    if (text != NULL) {
+        lv2_atom_forge_string(forge, text, (uint32_t) strlen(text));
+    } else {
+        lv2_atom_forge_int(forge, number);
+    }
+    lv2_atom_forge_pop(forge, &frame);
+}
+
+// Play from the start of the transport for N_BLOCKS blocks, and keep the notes played. A block before the transport
+// starts may set, with patch messages, what has no ports (a lane, a groove and a combination) and what has (the beats
+// and the velocity of a generator, leaving its ports where they were).
+static long play(Test_plugin *plugin, bool patches, Note *notes) {
+    LV2_Atom_Forge forge;
+    lv2_atom_forge_init(&forge, &host.map);
+    long n_notes = 0;
+
+    for (long block = -1; block < N_BLOCKS; ++block) {
+        LV2_Atom_Forge_Frame sequence_frame;
+        lv2_atom_forge_set_buffer(&forge, plugin->control, sizeof(plugin->control));
+        lv2_atom_forge_sequence_head(&forge, &sequence_frame, 0);
+        if (block < 0 && patches) {
+            forge_property(&forge, 0, EUCLIDEAN__beats, 16, NULL);
+            forge_property(&forge, 0, EUCLIDEAN__velocity, 33, NULL);
+            forge_property(&forge, 1, EUCLIDEAN__accent, 0, "x..x.x");
+            forge_property(&forge, 1, EUCLIDEAN__swing, 30, NULL);
+            forge_property(&forge, 3, EUCLIDEAN__combination, COMBINE_AND_NOT, NULL);
+            forge_property(&forge, 3, EUCLIDEAN__first, 2, NULL);
+            forge_property(&forge, 3, EUCLIDEAN__second, 1, NULL);
+        } else if (block == 0) {
+            host_forge_position(&host, &forge, 0, 0, 1, 120, 4, 0);
+        } else if (block == N_BLOCKS / 2) {
+            // one of the generators combined changes, and so does the combination
+            plugin->ports[1][ONSETS_IDX] = 2;
+        }
+        lv2_atom_forge_pop(&forge, &sequence_frame);
+
+        ((LV2_Atom *) plugin->midi_out)->size = MIDI_OUT_CAPACITY - sizeof(LV2_Atom);
+        descriptor.run(plugin->instance, BLOCK_SIZE);
+        LV2_ATOM_SEQUENCE_FOREACH((const LV2_Atom_Sequence *) plugin->midi_out, event) {
+            if (n_notes < MAX_NOTES) {
+                notes[n_notes].frame = block * BLOCK_SIZE + event->time.frames;
+                memcpy(notes[n_notes].message, event + 1, sizeof(notes[n_notes].message));
+                n_notes++;
+            }
+        }
+    }
+    return n_notes;
+}
+
+// Snapshots taken from another thread, as a host saving a session while it plays: the pattern of each, if it has
+// one, has to be the pattern its parameters make
+typedef struct {
+    Test_plugin *plugin;
+    bool done;
+    long snapshots;
+    long wrong_patterns;
+} Saver;
+
+static LV2_State_Status check_snapshot(LV2_State_Handle handle, uint32_t key, const void *value, size_t size,
+                                       uint32_t type, uint32_t flags) {
+    (void) key, (void) type, (void) flags;
+    Saver *saver = (Saver *) handle;
+    if (size != sizeof(Snapshot)) {
+        return LV2_STATE_ERR_NO_SPACE;
+    }
+    const Snapshot *snapshot = (const Snapshot *) value;
+    for (unsigned short gen = 0; gen < N_GENERATORS; ++gen) {
+        const Generator_snapshot *generator = &snapshot->generators[gen];
+        pattern expected;
+        pattern_euclidean(&expected, generator->onsets, generator->beats, generator->rotation);
+        saver->wrong_patterns += generator->has_pattern && memcmp(&generator->euclidean, &expected, sizeof(pattern));
+    }
+    saver->snapshots++;
+    return LV2_STATE_SUCCESS;
+}
+
+static void *keep_saving(void *data) {
+    Saver *saver = (Saver *) data;
+    while (!__atomic_load_n(&saver->done, __ATOMIC_ACQUIRE)) {
+        state_interface->save(saver->plugin->instance, check_snapshot, saver, 0, host.features);
+    }
+    return NULL;
+}
+
+// Play with every generator changing its onsets all the time, while another thread saves
+static bool save_while_swapping(void) {
+    Test_plugin *plugin = start_plugin();
+    for (unsigned short gen = 0; gen < N_GENERATORS; ++gen) {
+        plugin->ports[gen][ENABLED_IDX] = 1;
+    }
+    Saver saver = {plugin, false, 0, 0};
+    pthread_t saving;
+    if (pthread_create(&saving, NULL, keep_saving, &saver) != 0) {
+        stop_plugin(plugin);
+        return false;
+    }
+
+    LV2_Atom_Forge forge;
+    lv2_atom_forge_init(&forge, &host.map);
+    for (long block = 0; block < RACE_BLOCKS; ++block) {
+        LV2_Atom_Forge_Frame sequence_frame;
+        lv2_atom_forge_set_buffer(&forge, plugin->control, sizeof(plugin->control));
+        lv2_atom_forge_sequence_head(&forge, &sequence_frame, 0);
+        if (block == 0) {
+            host_forge_position(&host, &forge, 0, 0, 1, RACE_TEMPO, 4, 0);
+        }
+        lv2_atom_forge_pop(&forge, &sequence_frame);
+        for (unsigned short gen = 0; gen < N_GENERATORS; ++gen) {
+            plugin->ports[gen][ONSETS_IDX] = (float) (1 + (block + gen) % 7);
+        }
+
+        ((LV2_Atom *) plugin->midi_out)->size = MIDI_OUT_CAPACITY - sizeof(LV2_Atom);
+        descriptor.run(plugin->instance, BLOCK_SIZE);
+    }
+
+    __atomic_store_n(&saver.done, true, __ATOMIC_RELEASE);
+    pthread_join(saving, NULL);
+    stop_plugin(plugin);
+    printf("%ld snapshots, %ld wrong patterns\n", saver.snapshots, saver.wrong_patterns);
+    return saver.snapshots > 0 && saver.wrong_patterns == 0;
+}
+
+static bool restored(LV2_Handle instance) {
+    return state_interface->restore(instance, retrieve, NULL, 0, host.features) == LV2_STATE_SUCCESS;
+}
+
+int main(void) {
+    static Note played[MAX_NOTES], replayed[MAX_NOTES];
+    host_init(&host);
+    state_interface = (const LV2_State_Interface *) descriptor.extension_data(LV2_STATE__interface);
+    bool passed = true;
+
+    // What is saved plays once restored as an instance that was never saved: the ports as the host sets them again
+    // (where they were at the time), and everything else as it was
+    Test_plugin *original = start_plugin();
+    play(original, true, played);
+    passed &= check(state_interface->save(original->instance, store, NULL, 0, host.features) == LV2_STATE_SUCCESS,
+                    "saving the state");
+    Test_plugin *reference = start_plugin();
+    memcpy(reference->ports, original->ports, sizeof(original->ports));
+    const long n_played = play(reference, true, played);
+    Test_plugin *copy = start_plugin();
+    memcpy(copy->ports, original->ports, sizeof(original->ports));
+    passed &= check(restored(copy->instance), "restoring it");
+    const long n_replayed = play(copy, false, replayed);
+    passed &= check(n_played > 0 && n_played == n_replayed && !memcmp(played, replayed, n_played * sizeof(Note)),
+                    "playing what was saved");
+    stop_plugin(reference);
+
+    // Snapshots with parameters that no port takes are turned down, and leave the instance as it was
+    const Snapshot good = *(const Snapshot *) saved.value;
+    Snapshot *snapshot = (Snapshot *) saved.value;
+    snapshot->generators[0].beats = 1;
+    passed &= check(!restored(copy->instance), "turning down a pattern of 1 beat");
+    *snapshot = good;
+    snapshot->generators[1].onsets = MAX_BEATS + 1;
+    passed &= check(!restored(copy->instance), "turning down too many onsets");
+    *snapshot = good;
+    snapshot->generators[2].size_in_bars = 0;
+    passed &= check(!restored(copy->instance), "turning down a pattern of 0 bars");
+    *snapshot = good;
+    snapshot->generators[2].size_in_bars = 9;
+    passed &= check(!restored(copy->instance), "turning down a pattern of 9 bars");
+    *snapshot = good;
+    saved.size--;
+    passed &= check(!restored(copy->instance), "turning down a snapshot of the wrong size");
+    saved.size++;
+
+    // ...and so are those whose patterns don't follow from their parameters, which don't make it to the cache (where
+    // no instance has put the pattern yet)
+    Generator_snapshot *generator = &snapshot->generators[2];
+    generator->onsets = 7;
+    generator->beats = 19;
+    generator->rotation = 0;
+    generator->has_pattern = 1;
+    pattern_euclidean(&generator->euclidean, generator->onsets, generator->beats, generator->rotation);
+    pattern expected = generator->euclidean;
+    generator->euclidean.w[0] ^= 1ULL << 63;
+    passed &= check(!restored(copy->instance), "turning down a corrupt pattern");
+    const Pattern_entry *entry = pattern_cache_acquire(generator->onsets, generator->beats, generator->rotation, NULL);
+    passed &= check(entry != NULL && !memcmp(&entry->euclidean, &expected, sizeof(pattern)),
+                    "keeping the corrupt pattern out of the cache");
+    pattern_cache_release(entry);
+    *snapshot = good;
+
+    passed &= check(save_while_swapping(), "saving while patterns are swapped in");
+
+    stop_plugin(original);
+    stop_plugin(copy);
+    host_free(&host);
+    return passed ? 0 : 1;
+}